@@ -4,10 +4,12 @@ import dataclasses
 from dataclasses import dataclass
 import datetime
 from functools import singledispatchmethod
+import numpy as np
 import pandas as pd
 import pathlib
 import re
 import typing
+import uuid
 from worker.errors import LogParseException
 
 
@@ -18,6 +20,7 @@ class WorkItem:
     start_time: datetime.datetime = None
     duration: datetime.timedelta = None
     status: int = None
+    timed_out: bool = False
 
 
 def convert_to_dict(workitems):
@@ -64,14 +67,22 @@ class WorkitemLogParser(LogParser):
         self._exprs['msg'] = r'workitem\s+{workitem_id}'.format(**self._exprs)
         self._exprs['started_msg'] = r'{msg}\s+started\s*:\s*{client_id}'.format(**self._exprs)
         self._exprs['done_msg'] = r'{msg}\s+done\s*:\s*{exit_status}'.format(**self._exprs)
+        self._exprs['timed_out_msg'] = r'{msg}\s+timed\s+out'.format(**self._exprs)
         self._log_line_expr = re.compile(r'{prefix}\s+.+'.format(**self._exprs))
         self._started_expr = re.compile(r'{prefix}\s+{started_msg}'.format(**self._exprs))
         self._done_expr = re.compile(r'{prefix}\s+{done_msg}'.format(**self._exprs))
+        self._timed_out_expr = re.compile(r'{prefix}\s+{timed_out_msg}'.format(**self._exprs))
+        self._workfile_expr = re.compile(r'{prefix}\s+workfile\s+has\s+(?P<nr_items>\d+)\s+work\s+items'.format(**self._exprs))
+        self._resumed_expr = re.compile(r"{prefix}\s+resumed\s+from\s+'(?P<resumed_dir>.*)'".format(**self._exprs))
+        self.nr_items = None
+        self.resumed_dir = None
 
     def _parse(self, file):
         workitems = defaultdict(WorkItem)
         nr_lines = 0
         nr_log_lines = 0
+        self.nr_items = None
+        self.resumed_dir = None
         for line in file:
             nr_lines += 1
             if self._log_line_expr.match(line):
@@ -86,6 +97,13 @@ class WorkitemLogParser(LogParser):
                 workitems[item_id].status = int(match.group('exit_status'))
                 end_time = WorkitemLogParser.parse_time(match.group('datetime'))
                 workitems[item_id].duration = end_time - workitems[item_id].start_time
+            elif (match := self._timed_out_expr.match(line)) is not None:
+                item_id = int(match.group('workitem_id'))
+                workitems[item_id].timed_out = True
+            elif (match := self._workfile_expr.match(line)) is not None:
+                self.nr_items = int(match.group('nr_items'))
+            elif (match := self._resumed_expr.match(line)) is not None:
+                self.resumed_dir = match.group('resumed_dir')
         if nr_lines == 0:
             raise LogParseException('empty log file')
         if nr_log_lines < nr_lines:
@@ -95,6 +113,151 @@ class WorkitemLogParser(LogParser):
         return WorkitemReport(pd.DataFrame(convert_to_dict(workitems.values())).set_index('item_id'))
 
 
+class JournalParser:
+    '''Parser for the binary journal the server writes, see journal.h for
+    its format.  The records are mapped into a structured numpy array,
+    so no line by line parsing is required.  The number of work items
+    and the directory of the run that was resumed, if any, are taken
+    from the header.
+    '''
+
+    MAGIC = b'WRKJNL01'
+    HEADER_DTYPE = np.dtype([('magic', 'S8'), ('start_time', '<i8'),
+                             ('nr_items', '<u8'), ('dir_length', '<u8')])
+    RECORD_DTYPE = np.dtype([('event', 'u1'), ('reserved', 'V3'),
+                             ('value', '<i4'), ('work_id', '<u8'),
+                             ('time', '<i8')])
+
+    def __init__(self):
+        self.nr_items = None
+        self.resumed_dir = None
+
+    def parse(self, file_name):
+        with open(file_name, 'rb') as file:
+            header = np.fromfile(file, dtype=self.HEADER_DTYPE, count=1)
+            if len(header) == 0 or header['magic'][0] != self.MAGIC:
+                raise LogParseException('file is not a journal')
+            dir_length = int(header['dir_length'][0])
+            self.nr_items = int(header['nr_items'][0])
+            self.resumed_dir = file.read(dir_length).decode() or None
+            offset = self.HEADER_DTYPE.itemsize + dir_length
+        # a partial record at the end, if any, is still being written, it
+        # is ignored
+        nr_records = (pathlib.Path(file_name).stat().st_size - offset)//self.RECORD_DTYPE.itemsize
+        if nr_records == 0:
+            return None
+        records = np.memmap(file_name, dtype=self.RECORD_DTYPE, mode='r',
+                            offset=offset, shape=(nr_records,))
+        events = records['event']
+        # clients are numbered in the order of their first work item, the
+        # UUID takes the place of the work item ID and the time
+        client_ids = [str(uuid.UUID(bytes=records[i].tobytes()[8:]))
+                      for i in np.flatnonzero(events == ord('c'))]
+        started = records[events == ord('s')]
+        done = records[events == ord('d')]
+        timed_out = records[events == ord('t')]
+        if len(started) == 0:
+            return None
+        # the state of the work items is kept in arrays indexed by their
+        # IDs, for a work item started more than once, the last start
+        # counts, and the first result
+        nr_items = max(int(header['nr_items'][0]), int(started['work_id'].max()))
+        start_times = np.zeros(nr_items + 1, dtype=np.int64)
+        start_times[started['work_id']] = started['time']
+        clients = np.zeros(nr_items + 1, dtype=np.int32)
+        clients[started['work_id']] = started['value']
+        end_times = np.zeros(nr_items + 1, dtype=np.int64)
+        end_times[done['work_id'][::-1]] = done['time'][::-1]
+        statuses = np.full(nr_items + 1, np.nan)
+        statuses[done['work_id'][::-1]] = done['value'][::-1]
+        is_timed_out = np.zeros(nr_items + 1, dtype=bool)
+        is_timed_out[timed_out['work_id']] = True
+        item_ids = np.flatnonzero(start_times)
+        durations = (end_times[item_ids] - start_times[item_ids]).astype('timedelta64[us]')
+        durations[end_times[item_ids] == 0] = np.timedelta64('NaT')
+        df = pd.DataFrame({
+            'client_id': pd.Categorical.from_codes(clients[item_ids], client_ids),
+            'start_time': start_times[item_ids].astype('datetime64[us]'),
+            'duration': durations,
+            'status': statuses[item_ids],
+            'timed_out': is_timed_out[item_ids],
+        }, index=pd.Index(item_ids, name='item_id'))
+        return WorkitemReport(df)
+
+
+
+def get_nr_remaining_items(job_dir, is_redo=False):
+    '''number of work items a job that resumes a previous job would run,
+    the work items completed before are read as the server does, from the
+    journal of the previous job, or else from its log, and from those of
+    the jobs it resumed in turn
+
+    Parameters
+    ----------
+    job_dir: pathlib.Path
+        directory of the previous job
+    is_redo: bool
+        True if work items that failed are to be done again
+
+    Returns
+    -------
+    int or None
+        number of work items to do, None if that can not be determined
+    '''
+    nr_items = None
+    completed = set()
+    job_dirs = [pathlib.Path(job_dir)]
+    visited = set()
+    while job_dirs:
+        job_dir = job_dirs.pop().resolve()
+        if job_dir in visited:
+            continue
+        visited.add(job_dir)
+        if (job_dir / 'journal.bin').exists():
+            parser, file_name = JournalParser(), job_dir / 'journal.bin'
+        else:
+            parser, file_name = WorkitemLogParser(), job_dir / 'server.log'
+        try:
+            report = parser.parse(file_name)
+        except (OSError, LogParseException):
+            return None
+        if nr_items is None:
+            nr_items = parser.nr_items
+        if parser.resumed_dir is not None:
+            job_dirs.append(pathlib.Path(parser.resumed_dir))
+        if report is not None:
+            completed.update(report.successes)
+            if not is_redo:
+                completed.update(report.failures)
+    if nr_items is None:
+        return None
+    return nr_items - sum(1 for work_id in completed if 1 <= work_id <= nr_items)
+
+class UsageParser:
+    '''Parser for the file in which the server records the resources used
+    by each work item.  Times are converted to seconds, the CPU usage is
+    the CPU time divided by the walltime, i.e., the number of cores the
+    work item kept busy on average.
+    '''
+
+    def parse(self, file_name):
+        df = pd.read_csv(file_name, sep='\t', index_col='item_id')
+        if len(df) == 0:
+            return None
+        usage = pd.DataFrame({
+            'status': df['status'],
+            'walltime': df['walltime_us']/1.0e6,
+            'user_time': df['user_time_us']/1.0e6,
+            'system_time': df['system_time_us']/1.0e6,
+            'max_rss_mb': df['max_rss_kb']/1024.0,
+            'read_blocks': df['read_blocks'],
+            'write_blocks': df['write_blocks'],
+        })
+        usage['cpu_usage'] = ((usage['user_time'] + usage['system_time'])/
+                              usage['walltime'].where(usage['walltime'] > 0))
+        return usage.sort_index()
+
+
 class WorkitemReport:
 
     def __init__(self, df):
@@ -112,6 +275,10 @@ class WorkitemReport:
     def failures(self):
         return list(sorted(self._df.dropna().query('status != 0').index))
 
+    @property
+    def timed_outs(self):
+        return list(sorted(self._df[self._df['timed_out']].index))
+
     @property
     def incompletes(self):
         return list(sorted(self._df[self._df['status'].isnull()].index))
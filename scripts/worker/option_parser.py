@@ -107,6 +107,49 @@ class OptionParser:
         self._worker_parser = argparse.ArgumentParser(add_help=False)
         self._worker_parser.add_argument('--num_cores', type=int, default=1,
                                            help='number of cores per work item')
+        self._worker_parser.add_argument('--node_clients', action='store_true',
+                                           help='launch a single client per node that runs '
+                                                'multiple work items concurrently')
+        self._worker_parser.add_argument('--prefetch', type=int, default=0,
+                                           help='number of work items a client requests ahead of time')
+        self._worker_parser.add_argument('--persistent_shell', action='store_true',
+                                           help='clients run the work items of a slot in a single, '
+                                                'long running shell')
+        self._worker_parser.add_argument('--no_login', action='store_true',
+                                           help='run work items in a non-login shell')
+        self._worker_parser.add_argument('--item_walltime',
+                                           help='walltime limit of a work item, [[HH:]MM:]SS, '
+                                                'work items that exceed it are killed')
+        self._worker_parser.add_argument('--ordered', action='store_true',
+                                           help='write output in the order of the work items')
+        self._worker_parser.add_argument('--longest_first', action='store_true',
+                                           help='dispatch the work items with the longest expected '
+                                                'walltime first')
+        self._worker_parser.add_argument('--estimates',
+                                           help='directory of a previous job with the same work items, '
+                                                'their walltimes are the expected walltimes, implies '
+                                                '--longest_first')
+        self._worker_parser.add_argument('--speculative_copies', type=int, default=0,
+                                           help='maximum number of copies of a straggling work item '
+                                                'that run on idle clients at the end of the job')
+        self._worker_parser.add_argument('--max_attempts', type=int, default=1,
+                                           help='maximum number of times a work item that fails '
+                                                'is run in the job')
+        self._worker_parser.add_argument('--retry_exit_codes',
+                                           help='comma separated exit statuses of work items that '
+                                                'are retried, by default any non-zero exit status')
+        self._worker_parser.add_argument('--retry_backoff', type=int,
+                                           help='time in seconds before a failed work item is '
+                                                'retried, doubles with each attempt')
+        self._worker_parser.add_argument('--retry_elsewhere', action='store_true',
+                                           help='retry a failed work item on another client, '
+                                                'if possible')
+        self._worker_parser.add_argument('--client_output', action='store_true',
+                                           help='clients write the output of work items to files '
+                                                'in the worker directory, the server keeps an index')
+        self._worker_parser.add_argument('--max_chunk_size', type=int, default=1,
+                                           help='maximum number of work items the server sends '
+                                                'to a client at once')
         self._worker_parser.add_argument('--port', type=int,
                                            help='port the worker server will listen on')
         self._worker_parser.add_argument('--verbose', action='store_true',
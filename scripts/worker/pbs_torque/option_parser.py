@@ -98,6 +98,9 @@ class PbsTorqueOptionParser:
                 elif line.startswith(directive_prefix) and parsing_pbs:
                     args.extend(shlex.split(line[len(directive_prefix):], comments=True))
                     pbs_directives += line
+                elif line.startswith('#WORKER '):
+                    # work item directives are kept in the work items
+                    script += line
                 elif (line.startswith('#') or line.isspace()) and parsing_pbs:
                     continue
                 else:
@@ -137,6 +137,9 @@ class SlurmOptionParser:
                         slurm_group0_directives += line
                     else:
                         slurm_directives += line
+                elif line.startswith('#WORKER '):
+                    # work item directives are kept in the work items
+                    script += line
                 elif (line.startswith('#') or line.isspace()) and parsing_slurm:
                     continue
                 else:
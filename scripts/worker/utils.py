@@ -140,6 +140,24 @@ def create_workfile(file_path, parser_result, config):
             print(parser_result.script, file=file)
     return nr_workitems
 
+def copy_workfile(workfile_path, file_path):
+    '''copy the workfile of a previous job, and its index, if any, the
+    work items are not parsed
+
+    Parameters
+    ----------
+    workfile_path: pathlib.Path
+        path to the workfile of the previous job
+    file_path: pathlib.Path
+        file path to copy the workfile to
+    '''
+    shutil.copy2(workfile_path, file_path)
+    # the index stays valid since the copy has the same size and
+    # modification time
+    index_path = workfile_path.with_name(workfile_path.name + '.idx')
+    if index_path.exists():
+        shutil.copy2(index_path, file_path.with_name(file_path.name + '.idx'))
+
 def create_jobscript(file_path, parser_result, template_path, config):
     '''create the job script for the computation
 
@@ -163,17 +181,121 @@ def create_jobscript(file_path, parser_result, template_path, config):
         'worker_path': config['worker']['path'],
         'server_info': str(worker_dir_path / 'server_info.txt'),
         'server_log_opt': f'--log "{str(worker_dir_path / "server.log")}"',
+        'journal_opt': f'--journal "{str(worker_dir_path / "journal.bin")}"',
+        'usage_opt': f'--usage "{str(worker_dir_path / "usage.txt")}"',
         'port_opt': f"--port {parser_result.options.port or config['worker']['worker_port']}",
+        'index_opt': f'--index "{str(worker_dir_path / "index.txt")}"' if parser_result.options.client_output else '',
+        'ordered_opt': '--ordered' if parser_result.options.ordered else '',
+        'resume_opt': get_resume_option(parser_result.options),
+        'schedule_opt': get_schedule_option(parser_result.options),
+        'retry_opt': get_retry_option(parser_result.options),
+        'copies_opt': f'--speculative_copies {parser_result.options.speculative_copies}' if parser_result.options.speculative_copies > 0 else '',
+        'chunk_opt': f'--max_chunk_size {parser_result.options.max_chunk_size}' if parser_result.options.max_chunk_size > 1 else '',
         'server_start_delay': config['worker']['server_start_delay'],
         'workfile': str(worker_dir_path / 'workerfile.txt'),
         'client_log_prefix_opt': f'--log_prefix "{str(worker_dir_path / "client_")}"',
+        'output_dir_opt': f'--output_dir "{str(worker_dir_path)}"' if parser_result.options.client_output else '',
+        'prefetch_opt': f'--prefetch {parser_result.options.prefetch}' if parser_result.options.prefetch else '',
+        'shell_opt': get_shell_option(parser_result.options),
+        'item_walltime_opt': f'--item_walltime {parser_result.options.item_walltime}' if parser_result.options.item_walltime else '',
         'env_var_exprs': f"{config['worker']['env_var_exprs']} {config['scheduler']['env_var_exprs']}",
         'num_cores': parser_result.options.num_cores,
         'exit_on_client_fail': 'false',
+        'node_clients': 'true' if parser_result.options.node_clients else 'false',
     }
     with open(file_path, 'w') as jobscript_file:
         print(template.format(**templ_params), file=jobscript_file)
 
+def get_shell_option(options):
+    '''client options for the shell that runs the work items
+
+    Parameters
+    ----------
+    options: argparse.Namespace
+        command line options
+
+    Returns
+    -------
+    str
+        options for the client, empty for a login shell per work item
+    '''
+    shell_opts = []
+    if options.persistent_shell:
+        shell_opts.append('--persistent_shell')
+    if options.no_login:
+        shell_opts.append('--no_login')
+    return ' '.join(shell_opts)
+
+def get_resume_option(options):
+    '''server options to resume a previous job, if any
+
+    Parameters
+    ----------
+    options: argparse.Namespace
+        command line options, for wresume they contain the directory of
+        the previous job
+
+    Returns
+    -------
+    str
+        options for the server, empty if no job is resumed
+    '''
+    previous_job_dir = getattr(options, 'dir', None)
+    if previous_job_dir is None:
+        return ''
+    resume_opt = f'--resume "{str(pathlib.Path(previous_job_dir).resolve())}"'
+    if getattr(options, 'redo', False):
+        resume_opt += ' --redo'
+    return resume_opt
+
+def get_retry_option(options):
+    '''server options for retrying work items that fail
+
+    Parameters
+    ----------
+    options: argparse.Namespace
+        command line options
+
+    Returns
+    -------
+    str
+        options for the server, empty when work items are not retried
+    '''
+    if options.max_attempts <= 1:
+        return ''
+    retry_opts = [f'--max_attempts {options.max_attempts}']
+    if options.retry_exit_codes:
+        retry_opts.append(f'--retry_exit_codes {options.retry_exit_codes}')
+    if options.retry_backoff is not None:
+        retry_opts.append(f'--retry_backoff {options.retry_backoff}')
+    if options.retry_elsewhere:
+        retry_opts.append('--retry_elsewhere')
+    return ' '.join(retry_opts)
+
+def get_schedule_option(options):
+    '''server options for the order in which work items are dispatched
+
+    Parameters
+    ----------
+    options: argparse.Namespace
+        command line options, for wresume they contain the directory of
+        the previous job
+
+    Returns
+    -------
+    str
+        options for the server, empty to dispatch work items in the order
+        of the workfile
+    '''
+    # a resumed job takes the walltimes of the work items from the
+    # previous job, unless other estimates are given
+    estimates_dir = options.estimates
+    if estimates_dir is None and options.longest_first:
+        estimates_dir = getattr(options, 'dir', None)
+    if estimates_dir is not None:
+        return f'--estimates "{str(pathlib.Path(estimates_dir).resolve())}"'
+    return '--longest_first' if options.longest_first else ''
+
 def submit_job(submit_cmd_path, jobscript_path, parser_result, config, original_cl_options):
     command = [config['scheduler']['submit_command']] +  original_cl_options + [str(jobscript_path)]
     command_str = shlex.join(command)
@@ -4,7 +4,7 @@ import argparse
 import pandas as pd
 import pathlib
 import worker.errors
-from worker.log_parsers import WorkitemLogParser
+from worker.log_parsers import JournalParser, UsageParser, WorkitemLogParser
 from worker.utils import exit_on_error
 import sys
 
@@ -15,6 +15,7 @@ if __name__ == '__main__':
     arg_parser = argparse.ArgumentParser(description='parse log file')
     input_group = arg_parser.add_mutually_exclusive_group(required=True)
     input_group.add_argument('--log', help='log file to parse')
+    input_group.add_argument('--journal', help='journal file to parse')
     input_group.add_argument('--dir', help='worker directory')
     arg_parser.add_argument('--show_raw', action='store_true',
                             help='show raw data')
@@ -28,14 +29,30 @@ if __name__ == '__main__':
                             help='show client statistics')
     arg_parser.add_argument('--show_all', action='store_true',
                             help='show all information')
+    arg_parser.add_argument('--usage',
+                            help='file with the resource usage of work items, '
+                                 'by default usage.txt in the worker directory')
+    arg_parser.add_argument('--show_usage_stats', action='store_true',
+                            help='show statistics on the resource usage of work items')
+    arg_parser.add_argument('--show_usage', type=int, nargs='+', metavar='ITEM_ID',
+                            help='show the resource usage of the given work items')
     options = arg_parser.parse_args()
-    parser = WorkitemLogParser()
+    usage_file = options.usage
+    if usage_file is None and options.dir:
+        usage_file = str(pathlib.Path(options.dir) / 'usage.txt')
     try:
         if options.log:
-            report = parser.parse(options.log)
+            report = WorkitemLogParser().parse(options.log)
+        elif options.journal:
+            report = JournalParser().parse(options.journal)
         else:
+            # the journal is preferred, the log is only parsed for jobs
+            # that have none
             path = pathlib.Path(options.dir)
-            report = parser.parse(str(path / 'server.log'))
+            if (path / 'journal.bin').exists():
+                report = JournalParser().parse(str(path / 'journal.bin'))
+            else:
+                report = WorkitemLogParser().parse(str(path / 'server.log'))
     except FileNotFoundError as error:
         exit_on_error(worker.errors.log_file_error, msg=error)
     except NotADirectoryError as error:
@@ -55,6 +72,9 @@ if __name__ == '__main__':
     print(f'failure: {len(report.failures)}')
     if options.show_failed or options.show_all:
         print('\t' + ' '.join(str(work_id) for work_id in report.failures))
+    print(f'timed out: {len(report.timed_outs)}')
+    if options.show_failed or options.show_all:
+        print('\t' + ' '.join(str(work_id) for work_id in report.timed_outs))
     print(f'incomplete: {len(report.incompletes)}')
     if options.show_incomplete or options.show_all:
         print('\t' + ' '.join(str(work_id) for work_id in report.incompletes))
@@ -67,3 +87,19 @@ if __name__ == '__main__':
         print(SEP)
         with pd.option_context('display.max_columns', None, 'display.max_rows', None):
             print(report.client_stats)
+    if options.show_usage_stats or options.show_usage or options.show_all:
+        try:
+            usage = UsageParser().parse(usage_file) if usage_file else None
+        except FileNotFoundError as error:
+            if not options.show_all:
+                exit_on_error(worker.errors.log_file_error, msg=error)
+            usage = None
+        if usage is not None:
+            with pd.option_context('display.max_columns', None, 'display.max_rows', None):
+                if options.show_usage_stats or options.show_all:
+                    print(SEP)
+                    print('workitem resource usage statistics:')
+                    print(usage.drop(columns='status').describe())
+                if options.show_usage:
+                    print(SEP)
+                    print(usage.reindex(options.show_usage))
@@ -6,28 +6,50 @@
 #include <boost/program_options.hpp>
 #include <boost/uuid/uuid_generators.hpp>
 #include <boost/uuid/uuid_io.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <csignal>
+#include <deque>
+#include <fstream>
 #include <iostream>
+#include <memory>
+#include <optional>
+#include <set>
 #include <sstream>
 #include <string>
+#include <system_error>
 #include <vector>
 #include <zmq.hpp>
 
 #include "message.h"
 #include "utils.h"
+#include "work_processor/directives.h"
 #include "work_processor/processor.h"
+#include "work_processor/slot_pool.h"
 #include "worker_exception.h"
 
 using Uuid = boost::uuids::uuid;
 using EnvVarOptions = std::vector<std::string>;
 
 using Options = struct {
+    std::string server_info;
     std::string server_name;
     Uuid server_id;
     int time_out;
+    int heartbeat_interval;
+    long deadline;
     std::string log_name_prefix;
     std::string log_name_ext;
+    boost::log::trivial::severity_level log_level;
     std::string numactl;
     int nr_cores;
+    int nr_slots;
+    size_t nr_prefetch;
+    worker::work_processor::Output_options output_options;
+    worker::work_processor::Shell_options shell_options;
+    std::chrono::seconds item_walltime;
+    std::string output_dir;
     std::string host_info;
     EnvVarOptions env_variables;
 };
@@ -38,13 +60,62 @@ namespace logging = boost::log;
 namespace wm = worker::message;
 namespace wpr = worker::work_processor;
 
+/*
+  Results the client sent are kept until the server confirmed them, and
+  are sent again when the client reconnects, since they may have been
+  lost with the old socket.  The server replies right away to result,
+  result_chunk, leave, and heartbeat messages, in the order it receives
+  them, so such a reply also confirms the messages sent before the one
+  it replies to.  Replies to queries may be delayed, they confirm nothing.
+ */
+using Sent_results = struct {
+    // number of replies received over the socket that confirms them
+    size_t nr_replies;
+    wm::Chunk results;
+};
+
+zmq::socket_t connect_socket(zmq::context_t& context, const Options& options);
+bool send_results(zmq::socket_t& socket, wm::Message_builder& msg_builder,
+        const Uuid& server_id, const wm::Chunk& results, bool needs_work);
+bool send_heartbeat(zmq::socket_t& socket, wm::Message_builder& msg_builder,
+        const Uuid& server_id);
+bool send_resync(zmq::socket_t& socket, wm::Message_builder& msg_builder,
+        const Uuid& server_id, const std::set<size_t>& held);
+bool send_leave(zmq::socket_t& socket, wm::Message_builder& msg_builder,
+        const Uuid& server_id, const std::set<size_t>& held);
+
+// maximum time results are held by the client before sending them
+const std::chrono::milliseconds result_flush_interval {1000};
+// the time out for a reply doubles with each reconnect, up to this
+// multiple of the client's time out
+const int max_backoff {16};
+
+// set by the signal handler when the client is asked to leave
+volatile std::sig_atomic_t is_leave_requested {0};
+
+void request_leave(int) {
+    is_leave_requested = 1;
+}
+
 int main(int argc, char* argv[]) {
     // handle command line options
     auto options = get_options(argc, argv);
 
+    // a work item's process may exit before it has read its script,
+    // writing to its standard input should fail rather than kill the client
+    std::signal(SIGPIPE, SIG_IGN);
+    // the client leaves the server gracefully on SIGUSR1, e.g., sent by
+    // the scheduler before the end of the job
+    std::signal(SIGUSR1, request_leave);
+
     // create UUID for this client
     Uuid client_id = boost::uuids::random_generator()();
     std::cout << client_id << std::endl;
+    if (!options.output_dir.empty())
+        options.output_options.store_prefix = (
+                boost::filesystem::path(options.output_dir) /
+                ("output_" + boost::lexical_cast<std::string>(client_id))
+            ).string();
 
     // parse environment variables
     wpr::Env env {boost::this_process::environment()};
@@ -61,20 +132,19 @@ int main(int argc, char* argv[]) {
     
     using namespace logging::trivial;
     try {
-        init_logging(log_name);
+        init_logging(log_name, options.log_level);
         BOOST_LOG_TRIVIAL(info) << "client ID " << client_id;
     } catch (boost::wrapexcept<boost::filesystem::filesystem_error>& err) {
         std::cerr << "### error: can not create log file, " << err.what() << std::endl;
         worker::exit(worker::Error::file);
     }
 
-    // create socket and connect to server
+    // create socket and connect to server, a DEALER socket is used since
+    // the server uses a ROUTER socket
     zmq::context_t context(1);
-    zmq::socket_t socket(context, ZMQ_REQ);
-    socket.set(zmq::sockopt::rcvtimeo, options.time_out);
-    socket.set(zmq::sockopt::sndtimeo, options.time_out);
+    zmq::socket_t socket;
     try {
-        socket.connect(options.server_name);
+        socket = connect_socket(context, options);
         BOOST_LOG_TRIVIAL(info) << "connected to server"
                                     << options.server_name;
     } catch (zmq::error_t& err) {
@@ -85,115 +155,578 @@ int main(int argc, char* argv[]) {
 
     wm::Message_builder msg_builder(client_id);
 
+    // the slots process work items concurrently, the message loop hands
+    // them work and sends their results to the server
+    std::unique_ptr<wpr::Slot_pool> slot_pool;
+    try {
+        slot_pool = std::make_unique<wpr::Slot_pool>(options.nr_slots, env,
+                                                     options.output_options,
+                                                     options.shell_options,
+                                                     options.item_walltime);
+    } catch (std::system_error& err) {
+        BOOST_LOG_TRIVIAL(fatal) << "can not create output files, " << err.what();
+        std::cerr << "### error: can not create output files in '"
+                  << options.output_dir << "'" << std::endl;
+        worker::exit(worker::Error::file);
+    }
+    auto& pool = *slot_pool;
+    BOOST_LOG_TRIVIAL(info) << "client has " << pool.nr_slots() << " slots";
+
+    // a client holds work items for each of its slots, and prefetches
+    // additional work items so that a slot can start on a new one as soon
+    // as it becomes idle, the number of work items the client can hold
+    // are its credits
+    const size_t nr_credits {static_cast<size_t>(pool.nr_slots()) +
+                             options.nr_prefetch};
+    // number of work items requested and of results the server has not
+    // replied to yet
+    size_t nr_requested {0};
+    size_t nr_results {0};
+    // set when the server has no more work, or when the client leaves
+    bool is_stopping {false};
+    bool is_leaving {false};
+    auto last_reply = std::chrono::steady_clock::now();
+    // when the server doesn't reply in time, the client reconnects, and
+    // waits twice as long for a reply, until it gives up when it didn't
+    // receive anything for the deadline
+    auto last_received = last_reply;
+    auto last_reconnect = last_reply;
+    auto reply_time_out = std::chrono::milliseconds(options.time_out);
+    const std::chrono::seconds deadline {options.deadline};
+    // IDs of the work items the client holds, either queued, running, or
+    // done, but not confirmed by the server yet
+    std::set<size_t> held;
+    // IDs of the work items another client completed, their results are
+    // not sent
+    std::set<size_t> cancelled;
+    // the client sends a heartbeat when it holds work items, but did not
+    // send a message for a while, so that the server renews their leases,
+    // while it waits for replies, it does so at least every half time
+    // out, so that the server replies in time, even if it parked the
+    // client's requests
+    const std::chrono::milliseconds heartbeat_interval {options.heartbeat_interval};
+    const auto waiting_heartbeat_interval = std::min(heartbeat_interval,
+            std::chrono::milliseconds(options.time_out/2));
+    auto last_sent = std::chrono::steady_clock::now();
+    // results not yet sent to the server, when the server sends chunks of
+    // work items, results are sent in chunks as well
+    wm::Chunk results;
+    auto first_result_time = std::chrono::steady_clock::now();
+    // results sent but not confirmed yet, the number of messages sent over
+    // the socket the server replies to right away, and of replies received
+    std::deque<Sent_results> unconfirmed;
+    size_t nr_replied_sent {0};
+    size_t nr_replies {0};
+
     // message loop
     for (;;) {
-        // ask server for work
-        auto msg = msg_builder.to(options.server_id)
-                           .subject(wm::Subject::query) .build();
-        zmq::message_t request = pack_message(msg);
-        BOOST_LOG_TRIVIAL(info) << "query message to " << msg.to();
-        auto query_send_status = socket.send(request, zmq::send_flags::none);
-        if (!query_send_status) {
-            BOOST_LOG_TRIVIAL(error) << "client can not send query message";
+        // when asked to leave, the work items that did not start are
+        // returned to the server, the others are finished
+        if (is_leave_requested && !is_leaving) {
+            is_leaving = true;
+            is_stopping = true;
+            for (auto work_id: pool.withdraw())
+                held.erase(work_id);
+            BOOST_LOG_TRIVIAL(info) << "leaving, finishing " << held.size()
+                                    << " items";
+            if (nr_requested + nr_results == 0)
+                last_reply = std::chrono::steady_clock::now();
+            nr_requested = 0;
+            if (send_leave(socket, msg_builder, options.server_id, held)) {
+                last_sent = std::chrono::steady_clock::now();
+                ++nr_results;
+                ++nr_replied_sent;
+            }
         }
-        // get and handle server's reply
-        zmq::message_t reply;
-        auto reply_recv_status = socket.recv(reply, zmq::recv_flags::none);
-        if (!reply_recv_status) {
-            BOOST_LOG_TRIVIAL(error) << "client can not receive query reply message";
+
+        // ask server for work using the credits that are available
+        if (!is_stopping && nr_requested + pool.nr_busy() < nr_credits) {
+            size_t nr_items = nr_credits - nr_requested - pool.nr_busy();
+            auto msg = msg_builder.to(options.server_id)
+                               .subject(wm::Subject::query)
+                               .content(std::to_string(nr_items)).build();
+            BOOST_LOG_TRIVIAL(debug) << "query message to " << msg.to()
+                                        << " for " << nr_items << " items";
+            if (send_message(socket, std::move(msg))) {
+                if (nr_requested + nr_results == 0)
+                    last_reply = std::chrono::steady_clock::now();
+                last_sent = std::chrono::steady_clock::now();
+                nr_requested += nr_items;
+            } else {
+                BOOST_LOG_TRIVIAL(error) << "client can not send query message";
+            }
         }
-        msg = unpack_message(reply, msg_builder);
-        if (msg.subject() == wm::Subject::stop) {
-            // no more work, stop
-            BOOST_LOG_TRIVIAL(info) << "stop message from "
-                                        << msg.from();
+        if (is_stopping && nr_requested == 0 && nr_results == 0 &&
+                pool.nr_busy() == 0 && results.empty())
             break;
-        } else if(msg.subject() == wm::Subject::work) {
-            // handle work
-            BOOST_LOG_TRIVIAL(info) << "work message for " << msg.id()
-                                        << " from " << msg.from();
-            auto work_str = msg.content();
-            auto work_id = msg.id();
-            BOOST_LOG_TRIVIAL(info) << "work item " << work_id
-                                        << " started";
-            // add item-specific info to the environment
-            env["WORKER_ITEM_ID"] = std::to_string(work_id);
-            // execute work item
-            auto result = wpr::process_work(work_str, env);
-            BOOST_LOG_TRIVIAL(info) << "work item " << work_id
-                                        << " finished: "
-                                        << result.exit_status();
-            // send result of work to server
-            auto result_msg = msg_builder.to(options.server_id)
-                                  .subject(wm::Subject::result).id(work_id)
-                                  .content(result.to_string()).build();
-            zmq::message_t result_reply = pack_message(result_msg);
-            BOOST_LOG_TRIVIAL(info) << "result message for " << result_msg.id()
-                                        << " to " << result_msg.to();
-            auto result_send_status = socket.send(result_reply, zmq::send_flags::none);
-            if (!result_send_status) {
-                BOOST_LOG_TRIVIAL(error) << "client can not send result message";
+
+        // wait for a reply from the server, or for completed work items,
+        // but don't hold on to results for too long, and send heartbeats
+        // in time
+        auto poll_time_out = std::chrono::milliseconds(options.time_out);
+        bool needs_heartbeat {pool.nr_busy() + nr_requested + nr_results > 0};
+        auto next_heartbeat_interval = nr_requested + nr_results > 0 ?
+                                       waiting_heartbeat_interval :
+                                       heartbeat_interval;
+        if (needs_heartbeat)
+            poll_time_out = std::min(poll_time_out,
+                    std::chrono::duration_cast<std::chrono::milliseconds>(
+                        last_sent + next_heartbeat_interval -
+                        std::chrono::steady_clock::now()));
+        if (!results.empty())
+            poll_time_out = std::min(poll_time_out,
+                    std::chrono::duration_cast<std::chrono::milliseconds>(
+                        first_result_time + result_flush_interval -
+                        std::chrono::steady_clock::now()));
+        zmq::pollitem_t items[] = {
+            {socket.handle(), 0, ZMQ_POLLIN, 0},
+            {nullptr, pool.notify_fd(), ZMQ_POLLIN, 0}
+        };
+        try {
+            zmq::poll(items, 2, std::max(poll_time_out,
+                                         std::chrono::milliseconds(0)));
+        } catch (zmq::error_t& err) {
+            // a signal to leave interrupts the poll
+            if (err.num() != EINTR)
+                throw;
+            continue;
+        }
+        auto now = std::chrono::steady_clock::now();
+        if (!(items[0].revents & ZMQ_POLLIN) && nr_requested + nr_results > 0 &&
+                (now - std::max(last_reply, last_reconnect) > reply_time_out ||
+                 now - last_received > deadline)) {
+            if (is_stopping) {
+                // the server stops clients once all work items are done,
+                // so these results were sent by another client as well,
+                // after this client's leases expired
+                BOOST_LOG_TRIVIAL(warning) << "results not acknowledged, "
+                                              "server is done";
+                nr_results = 0;
+                for (const auto& sent: unconfirmed)
+                    for (const auto& result: sent.results)
+                        held.erase(result.first);
+                unconfirmed.clear();
+            } else if (now - last_received > deadline) {
+                BOOST_LOG_TRIVIAL(fatal) << "client can not receive reply message";
+                worker::exit(worker::Error::socket);
+            } else {
+                // replies to requests sent over the old socket are lost,
+                // the server is told which work items the client holds,
+                // so that it requeues the others leased to this client
+                // and forgets its requests, which are sent again, as are
+                // the results it did not confirm
+                BOOST_LOG_TRIVIAL(warning) << "no reply in "
+                    << reply_time_out.count() << " ms, reconnecting";
+                try {
+                    socket = connect_socket(context, options);
+                } catch (zmq::error_t& err) {
+                    BOOST_LOG_TRIVIAL(fatal) << "socket connection failed, "
+                                             << err.what();
+                    worker::exit(worker::Error::socket);
+                }
+                last_reconnect = now;
+                reply_time_out = std::min(2*reply_time_out,
+                        max_backoff*std::chrono::milliseconds(options.time_out));
+                nr_requested = 0;
+                nr_results = 0;
+                nr_replied_sent = 0;
+                nr_replies = 0;
+                if (send_resync(socket, msg_builder, options.server_id, held)) {
+                    last_sent = now;
+                    ++nr_replied_sent;
+                }
+                // the server ignores results it already stored
+                if (!unconfirmed.empty()) {
+                    if (results.empty())
+                        first_result_time = now;
+                    wm::Chunk resent;
+                    for (auto& sent: unconfirmed)
+                        for (auto& result: sent.results)
+                            resent.push_back(std::move(result));
+                    unconfirmed.clear();
+                    for (auto& result: results)
+                        resent.push_back(std::move(result));
+                    results = std::move(resent);
+                    BOOST_LOG_TRIVIAL(info) << "resending " << results.size()
+                                            << " results";
+                }
+            }
+        }
+
+        // handle server's replies
+        if (items[0].revents & ZMQ_POLLIN) {
+            // a message that can not be parsed is dropped
+            std::optional<wm::Message> reply;
+            try {
+                reply = recv_message(socket, msg_builder);
+            } catch (wm::message_parse_exception& err) {
+                BOOST_LOG_TRIVIAL(warning) << "malformed message from "
+                    << "server dropped, " << err.what();
+                continue;
+            }
+            if (!reply) {
+                BOOST_LOG_TRIVIAL(fatal) << "client can not receive reply message";
+                worker::exit(worker::Error::socket);
             }
-            // wait for acknowledgement from server
-            zmq::message_t ack_response;
-            auto ack_recv_status = socket.recv(ack_response, zmq::recv_flags::none);
-            if (!ack_recv_status) {
-                BOOST_LOG_TRIVIAL(error) << "client can not receive result ack message";
+            last_reply = std::chrono::steady_clock::now();
+            last_received = last_reply;
+            reply_time_out = std::chrono::milliseconds(options.time_out);
+            auto msg = std::move(*reply);
+            if (msg.subject() == wm::Subject::stop) {
+                // no more work, stop once all work is done, no more work
+                // items will arrive for outstanding requests
+                BOOST_LOG_TRIVIAL(debug) << "stop message from "
+                                            << msg.from();
+                nr_requested = 0;
+                is_stopping = true;
+            } else if(msg.subject() == wm::Subject::work) {
+                // hand work to the slots, it is queued until a slot is idle
+                BOOST_LOG_TRIVIAL(debug) << "work message for " << msg.id()
+                                            << " from " << msg.from();
+                if (nr_requested > 0)
+                    --nr_requested;
+                if (is_leaving) {
+                    // the server requeued it when the client left
+                    BOOST_LOG_TRIVIAL(debug) << "work item " << msg.id()
+                                                << " returned";
+                    continue;
+                }
+                held.insert(msg.id());
+                pool.submit(msg.id(), msg.release_content());
+                BOOST_LOG_TRIVIAL(debug) << "work item " << msg.id()
+                                            << " queued";
+            } else if(msg.subject() == wm::Subject::work_chunk) {
+                // hand the chunk's work items to the slots, a chunk counts
+                // as a single request, one that can not be decoded is
+                // dropped, and the server is told which work items the
+                // client holds, so that it requeues the chunk's work items,
+                // the client's requests are sent again
+                wm::Chunk_view chunk;
+                try {
+                    chunk = wm::decode_chunk(msg.content());
+                } catch (wm::message_parse_exception& err) {
+                    BOOST_LOG_TRIVIAL(warning) << "malformed work_chunk from "
+                        << msg.from() << " dropped, " << err.what();
+                    nr_requested = 0;
+                    if (send_resync(socket, msg_builder, options.server_id,
+                                    held)) {
+                        last_sent = std::chrono::steady_clock::now();
+                        ++nr_replied_sent;
+                    }
+                    continue;
+                }
+                BOOST_LOG_TRIVIAL(debug) << "work_chunk message for "
+                                            << chunk.size() << " items from "
+                                            << msg.from();
+                if (nr_requested > 0)
+                    --nr_requested;
+                if (is_leaving) {
+                    BOOST_LOG_TRIVIAL(debug) << "work_chunk returned";
+                    continue;
+                }
+                for (const auto& [work_id, work_item]: chunk) {
+                    held.insert(work_id);
+                    pool.submit(work_id, std::string(work_item));
+                    BOOST_LOG_TRIVIAL(debug) << "work item " << work_id
+                                                << " queued";
+                }
+            } else if (msg.subject() == wm::Subject::cancel) {
+                // another client completed the work item, its result is
+                // dropped when it is still running or queued, or has not
+                // been sent yet
+                BOOST_LOG_TRIVIAL(debug) << "cancel message for " << msg.id()
+                                            << " from " << msg.from();
+                if (pool.cancel(msg.id())) {
+                    cancelled.insert(msg.id());
+                } else {
+                    auto result = std::find_if(results.begin(), results.end(),
+                            [&msg] (const auto& result) {
+                                return result.first == msg.id();
+                            });
+                    if (result != results.end()) {
+                        results.erase(result);
+                        held.erase(msg.id());
+                        BOOST_LOG_TRIVIAL(info) << "work item " << msg.id()
+                                                    << " cancelled";
+                    }
+                }
+            } else if (msg.subject() == wm::Subject::heartbeat) {
+                BOOST_LOG_TRIVIAL(debug) << "heartbeat message from "
+                    << msg.from();
+                ++nr_replies;
+            } else if (msg.subject() == wm::Subject::ack ||
+                       msg.subject() == wm::Subject::ack_stop) {
+                BOOST_LOG_TRIVIAL(debug) << "ack message from "
+                    << msg.from();
+                ++nr_replies;
+                if (nr_results > 0)
+                    --nr_results;
+                if (msg.subject() == wm::Subject::ack_stop) {
+                    // no more work, stop once all work is done, the
+                    // server may exit without replying to other queries
+                    BOOST_LOG_TRIVIAL(debug) << "stop message from "
+                                                << msg.from();
+                    nr_requested = 0;
+                    is_stopping = true;
+                }
             } else {
-                auto ack_msg = unpack_message(ack_response, msg_builder);
-                BOOST_LOG_TRIVIAL(info) << "ack message from "
-                    << ack_msg.from();
-                if (ack_msg.subject() == wm::Subject::ack_stop) {
-                    // no more work, stop
-                    BOOST_LOG_TRIVIAL(info) << "stop message from "
-                                                << ack_msg.from();
-                    break;
+                BOOST_LOG_TRIVIAL(warning) << "message with invalid subject "
+                    << "from " << msg.from() << " dropped";
+            }
+            while (!unconfirmed.empty() &&
+                    unconfirmed.front().nr_replies <= nr_replies) {
+                for (const auto& result: unconfirmed.front().results)
+                    held.erase(result.first);
+                unconfirmed.pop_front();
+            }
+        }
+
+        // collect results of completed work items
+        if (items[1].revents & ZMQ_POLLIN) {
+            for (auto& completed: pool.completed()) {
+                if (cancelled.erase(completed.work_id) > 0) {
+                    BOOST_LOG_TRIVIAL(info) << "work item "
+                        << completed.work_id << " cancelled";
+                    held.erase(completed.work_id);
+                    continue;
+                }
+                BOOST_LOG_TRIVIAL(info) << "work item " << completed.work_id
+                                            << " finished in slot "
+                                            << completed.slot << ": "
+                                            << completed.result.exit_status();
+                if (results.empty())
+                    first_result_time = std::chrono::steady_clock::now();
+                results.emplace_back(completed.work_id,
+                                     completed.result.encode());
+            }
+        }
+
+        // send results to the server when the client needs work, when
+        // there is no more work, or when results have been held for a while
+        bool needs_work {!is_stopping &&
+                         nr_requested + pool.nr_busy() < nr_credits};
+        if (!results.empty() && (needs_work || is_stopping ||
+                    std::chrono::steady_clock::now() - first_result_time >=
+                    result_flush_interval)) {
+            if (nr_requested + nr_results == 0)
+                last_reply = std::chrono::steady_clock::now();
+            // results that can not be sent are tried again
+            if (send_results(socket, msg_builder, options.server_id,
+                             results, needs_work)) {
+                last_sent = std::chrono::steady_clock::now();
+                // a single result is sent with a request for work for the
+                // idle slot when work is needed, the reply acknowledges it,
+                // but it may be delayed, so the reply to the next message
+                // confirms it
+                size_t nr_confirming;
+                if (results.size() == 1 && needs_work) {
+                    ++nr_requested;
+                    nr_confirming = nr_replied_sent + 1;
+                } else {
+                    ++nr_results;
+                    nr_confirming = ++nr_replied_sent;
                 }
+                unconfirmed.push_back({nr_confirming, std::move(results)});
+                results.clear();
+            }
+        }
+
+        // renew the leases of the work items this client holds, or has
+        // requested
+        if (needs_heartbeat &&
+                std::chrono::steady_clock::now() - last_sent >=
+                next_heartbeat_interval) {
+            if (send_heartbeat(socket, msg_builder, options.server_id)) {
+                last_sent = std::chrono::steady_clock::now();
+                ++nr_replied_sent;
             }
-        } else {
-            // unknown message type
-            BOOST_LOG_TRIVIAL(fatal) << "invalid message";
-            worker::exit(worker::Error::unexpected);
         }
     }
     BOOST_LOG_TRIVIAL(info) << "exiting normally";
+    stop_logging();
     return 0;
 }
 
+bool send_results(zmq::socket_t& socket, wm::Message_builder& msg_builder,
+        const Uuid& server_id, const wm::Chunk& results, bool needs_work) {
+    if (results.size() == 1) {
+        // a single result also requests work when needed
+        auto subject = needs_work ? wm::Subject::result_query
+                                  : wm::Subject::result;
+        auto result_msg = msg_builder.to(server_id)
+                              .subject(subject)
+                              .id(results.front().first)
+                              .content(results.front().second)
+                              .build();
+        BOOST_LOG_TRIVIAL(debug) << "result message for " << result_msg.id()
+                                    << " to " << result_msg.to();
+        if (!send_message(socket, std::move(result_msg))) {
+            BOOST_LOG_TRIVIAL(error) << "client can not send result message";
+            return false;
+        }
+    } else {
+        auto result_msg = msg_builder.to(server_id)
+                              .subject(wm::Subject::result_chunk)
+                              .content(wm::encode_chunk(results))
+                              .build();
+        BOOST_LOG_TRIVIAL(debug) << "result_chunk message for "
+                                    << results.size() << " items to "
+                                    << result_msg.to();
+        if (!send_message(socket, std::move(result_msg))) {
+            BOOST_LOG_TRIVIAL(error) << "client can not send result_chunk message";
+            return false;
+        }
+    }
+    return true;
+}
+
+zmq::socket_t connect_socket(zmq::context_t& context, const Options& options) {
+    zmq::socket_t socket(context, ZMQ_DEALER);
+    socket.set(zmq::sockopt::rcvtimeo, options.time_out);
+    socket.set(zmq::sockopt::sndtimeo, options.time_out);
+    // messages to a server that doesn't respond are dropped when the
+    // socket is replaced
+    socket.set(zmq::sockopt::linger, 0);
+    socket.connect(options.server_name);
+    return socket;
+}
+
+bool send_heartbeat(zmq::socket_t& socket, wm::Message_builder& msg_builder,
+        const Uuid& server_id) {
+    auto heartbeat_msg = msg_builder.to(server_id)
+                             .subject(wm::Subject::heartbeat)
+                             .build();
+    BOOST_LOG_TRIVIAL(debug) << "heartbeat message to "
+                                << heartbeat_msg.to();
+    if (!send_message(socket, std::move(heartbeat_msg))) {
+        BOOST_LOG_TRIVIAL(error) << "client can not send heartbeat message";
+        return false;
+    }
+    return true;
+}
+
+bool send_resync(zmq::socket_t& socket, wm::Message_builder& msg_builder,
+        const Uuid& server_id, const std::set<size_t>& held) {
+    // a heartbeat with content lists the work items the client holds
+    wm::Chunk work_items;
+    for (auto work_id: held)
+        work_items.emplace_back(work_id, "");
+    auto resync_msg = msg_builder.to(server_id)
+                          .subject(wm::Subject::heartbeat)
+                          .content(wm::encode_chunk(work_items))
+                          .build();
+    BOOST_LOG_TRIVIAL(debug) << "heartbeat message for " << held.size()
+                                << " items to " << resync_msg.to();
+    if (!send_message(socket, std::move(resync_msg))) {
+        BOOST_LOG_TRIVIAL(error) << "client can not send heartbeat message";
+        return false;
+    }
+    return true;
+}
+
+bool send_leave(zmq::socket_t& socket, wm::Message_builder& msg_builder,
+        const Uuid& server_id, const std::set<size_t>& held) {
+    // the content lists the work items the client still finishes
+    wm::Chunk work_items;
+    for (auto work_id: held)
+        work_items.emplace_back(work_id, "");
+    auto leave_msg = msg_builder.to(server_id)
+                         .subject(wm::Subject::leave)
+                         .content(wm::encode_chunk(work_items))
+                         .build();
+    BOOST_LOG_TRIVIAL(debug) << "leave message to " << leave_msg.to();
+    if (!send_message(socket, std::move(leave_msg))) {
+        BOOST_LOG_TRIVIAL(error) << "client can not send leave message";
+        return false;
+    }
+    return true;
+}
+
 Options get_options(int argc, char* argv[]) {
     Options options;
     namespace po = boost::program_options;
     std::string server_uuid_str {""};
+    bool is_no_login {false};
+    std::string item_walltime_str {""};
     const int default_time_out {1000};
+    // a third of the server's default lease time, so that a lease
+    // survives two lost heartbeats, and half of its minimum lease time
+    const int default_heartbeat_interval {10000};
+    const long default_deadline {120};
     std::string default_log_name_prefix {"client"};
     std::string default_log_name_ext {".log"};
     std::string default_numactl {""};
     int default_nr_cores {1};
+    int default_nr_slots {1};
+    size_t default_nr_prefetch {0};
+    size_t default_max_output_size {64*1024*1024};
+    std::string default_spill_dir {"."};
+    std::string default_output_dir {""};
     std::string default_host_info {boost::asio::ip::host_name() + ":1"};
 
     po::options_description desc("Allowed options");
     desc.add_options()
         ("help,h", "produce help message")
         ("version,v", "show software version")
-        ("server", po::value<std::string>(&options.server_name)->required(),
+        ("server_info", po::value<std::string>(&options.server_info),
+         "file the server stored its UUID and name in, to use instead "
+         "of the server and uuid options")
+        ("server", po::value<std::string>(&options.server_name),
          "name of the server to use")
-        ("uuid", po::value<std::string>(&server_uuid_str)->required(),
+        ("uuid", po::value<std::string>(&server_uuid_str),
          "server UUID")
         ("timeout,t", po::value<int>(&options.time_out)
          ->default_value(default_time_out),
          "client time out in ms")
+        ("heartbeat", po::value<int>(&options.heartbeat_interval)
+         ->default_value(default_heartbeat_interval),
+         "time in ms between heartbeats that renew the leases of the "
+         "client's work items, at most a third of the server's lease time")
+        ("deadline", po::value<long>(&options.deadline)
+         ->default_value(default_deadline),
+         "time in seconds the client reconnects to a server that doesn't "
+         "reply before it gives up")
         ("log_prefix", po::value<std::string>(&options.log_name_prefix)
          ->default_value(default_log_name_prefix),
          "log file name prefix")
         ("log_ext", po::value<std::string>(&options.log_name_ext)
          ->default_value(default_log_name_ext),
          "log file name extension")
+        ("log_level", po::value<boost::log::trivial::severity_level>(&options.log_level)
+         ->default_value(boost::log::trivial::info),
+         "least severe log records to write, i.e., trace, debug, info, "
+         "warning, error or fatal")
         ("numactl", po::value<std::string>(&options.numactl)
          ->default_value(default_numactl),
          "numactl optoins")
         ("num_cores", po::value<int>(&options.nr_cores)
          ->default_value(default_nr_cores),
          "number of cores the work items can use")
+        ("slots", po::value<int>(&options.nr_slots)
+         ->default_value(default_nr_slots),
+         "number of work items to process concurrently")
+        ("prefetch", po::value<size_t>(&options.nr_prefetch)
+         ->default_value(default_nr_prefetch),
+         "number of work items to request ahead of time")
+        ("persistent_shell", po::bool_switch(&options.shell_options.is_persistent),
+         "run the work items of a slot in a single, long running shell, "
+         "rather than starting a shell per work item")
+        ("no_login", po::bool_switch(&is_no_login),
+         "run work items in a non-login shell, so the profile is not read")
+        ("item_walltime", po::value<std::string>(&item_walltime_str),
+         "maximum walltime of a work item as [[HH:]MM:]SS, unless it has a "
+         "walltime directive, by default unlimited")
+        ("max_output_size", po::value<size_t>(&options.output_options.max_size)
+         ->default_value(default_max_output_size),
+         "bytes of standard output/error of a work item to keep in memory")
+        ("spill_dir", po::value<std::string>(&options.output_options.spill_dir)
+         ->default_value(default_spill_dir),
+         "directory for output beyond the maximum size, "
+         "it should be accessible to the server")
+        ("output_dir", po::value<std::string>(&options.output_dir)
+         ->default_value(default_output_dir),
+         "directory to write output of work items to, rather than "
+         "sending it to the server")
         ("host_info", po::value<std::string>(&options.host_info)
          ->default_value(default_host_info),
          "host information to construct an MPI hostfile")
@@ -233,6 +766,50 @@ Options get_options(int argc, char* argv[]) {
         worker::exit(worker::Error::cli_option);
     }
 
+    options.shell_options.is_login = !is_no_login;
+
+    options.item_walltime = std::chrono::seconds(0);
+    if (!item_walltime_str.empty()) {
+        try {
+            options.item_walltime = wpr::parse_duration(item_walltime_str);
+        } catch (wpr::directive_parse_exception&) {
+            std::cerr << "### error: invalid item walltime '"
+                      << item_walltime_str << "'" << std::endl;
+            worker::exit(worker::Error::cli_option);
+        }
+    }
+
+    if (options.nr_slots < 1) {
+        std::cerr << "### error: number of slots should be at least 1" << std::endl;
+        worker::exit(worker::Error::cli_option);
+    }
+
+    if (options.time_out < 2) {
+        std::cerr << "### error: time out should be at least 2 ms" << std::endl;
+        worker::exit(worker::Error::cli_option);
+    }
+
+    if (options.heartbeat_interval < 1) {
+        std::cerr << "### error: heartbeat interval should be positive"
+                  << std::endl;
+        worker::exit(worker::Error::cli_option);
+    }
+
+    // a client can join a running server using its server_info file
+    if (!options.server_info.empty()) {
+        std::ifstream ifs(options.server_info);
+        if (!(ifs >> server_uuid_str >> options.server_name)) {
+            std::cerr << "### error: can not read server_info file '"
+                      << options.server_info << "'" << std::endl;
+            worker::exit(worker::Error::file);
+        }
+    } else if (options.server_name.empty() || server_uuid_str.empty()) {
+        std::cerr << "### error: either server_info, or server and uuid "
+                  << "are required" << std::endl;
+        std::cerr << desc << std::endl;
+        worker::exit(worker::Error::cli_option);
+    }
+
     try {
         options.server_id = boost::lexical_cast<Uuid>(server_uuid_str);
     } catch (boost::wrapexcept<boost::bad_lexical_cast>&) {
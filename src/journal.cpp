@@ -0,0 +1,202 @@
+#include <boost/log/trivial.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <system_error>
+#include <unistd.h>
+
+#include "journal.h"
+#include "wire.h"
+
+namespace worker {
+
+    static const std::string journal_magic {"WRKJNL01"};
+    static const size_t record_size {24};
+    // size of the header without the name of the resumed directory
+    static const size_t fixed_header_size {8 + 3*8};
+    // commit early when this many bytes of records are waiting
+    static const size_t max_uncommitted_size {1024*1024};
+
+    static std::int64_t now() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    static bool write_all(int fd, const char* data, size_t size) {
+        while (size > 0) {
+            ssize_t nr_written = ::write(fd, data, size);
+            if (nr_written < 0) {
+                if (errno == EINTR)
+                    continue;
+                return false;
+            }
+            data += nr_written;
+            size -= nr_written;
+        }
+        return true;
+    }
+
+    Journal::Journal(const std::string& file_name, size_t nr_items,
+                     const std::string& resumed_dir,
+                     std::chrono::milliseconds commit_interval) :
+        commit_interval_ {commit_interval} {
+        fd_ = ::open(file_name.c_str(),
+                     O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+        if (fd_ < 0)
+            throw std::system_error(errno, std::generic_category(),
+                                    "can not create journal");
+        std::string header {journal_magic};
+        wire::put_uint(header, now(), 8);
+        wire::put_uint(header, nr_items, 8);
+        wire::put_uint(header, resumed_dir.length(), 8);
+        header += resumed_dir;
+        if (!write_all(fd_, header.data(), header.length())) {
+            int err = errno;
+            ::close(fd_);
+            throw std::system_error(err, std::generic_category(),
+                                    "can not write journal");
+        }
+        thread_ = std::thread(&Journal::run, this);
+    }
+
+    Journal::~Journal() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            is_done_ = true;
+        }
+        committable_.notify_one();
+        thread_.join();
+        ::close(fd_);
+    }
+
+    void Journal::started(size_t work_id, const boost::uuids::uuid& client_id) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto [client, is_new] = clients_.emplace(client_id, clients_.size());
+        if (is_new) {
+            wire::put_uint(records_, static_cast<char>(Journal_event::client), 4);
+            wire::put_uint(records_, client->second, 4);
+            records_.append(client_id.begin(), client_id.end());
+        }
+        append(Journal_event::started, client->second, work_id);
+    }
+
+    void Journal::done(size_t work_id, int exit_status) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        append(Journal_event::done, static_cast<std::uint32_t>(exit_status),
+               work_id);
+    }
+
+    void Journal::requeued(size_t work_id) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        append(Journal_event::requeued, 0, work_id);
+    }
+
+    void Journal::timed_out(size_t work_id) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        append(Journal_event::timed_out, 0, work_id);
+    }
+
+    void Journal::end() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        append(Journal_event::end, 0, 0);
+    }
+
+    void Journal::append(Journal_event event, std::uint32_t value,
+                         size_t work_id) {
+        wire::put_uint(records_, static_cast<char>(event), 4);
+        wire::put_uint(records_, value, 4);
+        wire::put_uint(records_, work_id, 8);
+        wire::put_uint(records_, now(), 8);
+        if (records_.length() >= max_uncommitted_size)
+            committable_.notify_one();
+    }
+
+    void Journal::run() {
+        for (;;) {
+            std::string records;
+            bool is_done;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                committable_.wait_for(lock, commit_interval_, [this] {
+                    return is_done_ || records_.length() >= max_uncommitted_size;
+                });
+                records.swap(records_);
+                is_done = is_done_;
+            }
+            if (!records.empty())
+                commit(records);
+            if (is_done)
+                return;
+        }
+    }
+
+    void Journal::commit(const std::string& records) {
+        if (!write_all(fd_, records.data(), records.length()) ||
+                ::fdatasync(fd_) != 0)
+            BOOST_LOG_TRIVIAL(error) << "could not write journal, "
+                << std::strerror(errno);
+    }
+
+    Journal_reader::Journal_reader(const std::string& file_name) {
+        fd_ = ::open(file_name.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd_ < 0)
+            throw journal_exception("can not open journal");
+        char header[fixed_header_size];
+        if (::pread(fd_, header, fixed_header_size, 0) !=
+                static_cast<ssize_t>(fixed_header_size) ||
+                journal_magic.compare(0, journal_magic.length(), header,
+                                      journal_magic.length()) != 0) {
+            ::close(fd_);
+            throw journal_exception("file is not a journal");
+        }
+        const char* fields = header + journal_magic.length();
+        start_time_ = static_cast<std::int64_t>(wire::get_uint(fields, 8));
+        nr_items_ = wire::get_uint(fields + 8, 8);
+        size_t dir_length = wire::get_uint(fields + 16, 8);
+        resumed_dir_.resize(dir_length);
+        if (::pread(fd_, resumed_dir_.data(), dir_length, fixed_header_size) !=
+                static_cast<ssize_t>(dir_length)) {
+            ::close(fd_);
+            throw journal_exception("journal header is truncated");
+        }
+        offset_ = fixed_header_size + dir_length;
+    }
+
+    Journal_reader::~Journal_reader() {
+        ::close(fd_);
+    }
+
+    size_t Journal_reader::read(std::vector<Journal_record>& records,
+                                size_t max_records) {
+        records.clear();
+        buffer_.resize(max_records*record_size);
+        ssize_t nr_read;
+        do {
+            nr_read = ::pread(fd_, buffer_.data(), buffer_.size(), offset_);
+        } while (nr_read < 0 && errno == EINTR);
+        if (nr_read <= 0)
+            return 0;
+        // a partial record at the end is read once it is complete
+        size_t nr_records = nr_read/record_size;
+        records.resize(nr_records);
+        const char* data = buffer_.data();
+        for (auto& record: records) {
+            record.event = static_cast<Journal_event>(data[0]);
+            record.client = static_cast<std::uint32_t>(wire::get_uint(data + 4, 4));
+            if (record.event == Journal_event::client) {
+                std::copy(data + 8, data + record_size, record.client_id.begin());
+                record.work_id = 0;
+                record.time = 0;
+            } else {
+                record.work_id = wire::get_uint(data + 8, 8);
+                record.time = static_cast<std::int64_t>(wire::get_uint(data + 16, 8));
+            }
+            record.exit_status = static_cast<int>(record.client);
+            data += record_size;
+        }
+        offset_ += nr_records*record_size;
+        return nr_records;
+    }
+
+}
@@ -0,0 +1,222 @@
+/*!
+  \file
+  \brief Binary journal of the state transitions of work items
+ */
+#ifndef JOURNAL_HDR
+#define JOURNAL_HDR
+
+#include <boost/uuid/uuid.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "worker_exception.h"
+
+namespace worker {
+
+    /*!
+      \brief events recorded in the journal
+     */
+    enum class Journal_event : char {
+        client = 'c',
+        started = 's',
+        done = 'd',
+        requeued = 'r',
+        timed_out = 't',
+        end = 'e',
+    };
+
+    /*!
+      \brief record of the journal
+
+      A record is 24 bytes: the event (1 byte), 3 reserved bytes, the
+      client number for a client or started event, or the exit status for
+      a done event (4 bytes), the work item ID (8 bytes), and the time in
+      microseconds since the epoch (8 bytes).  A client event has the
+      client's UUID in the last 16 bytes instead, it precedes the first
+      started event of that client.  All integers are little endian.
+     */
+    struct Journal_record {
+        Journal_event event;
+        std::uint32_t client;
+        int exit_status;
+        size_t work_id;
+        std::int64_t time;
+        boost::uuids::uuid client_id;
+    };
+
+    /*!
+      \brief Exception thrown when a journal can not be read
+     */
+    class journal_exception : public Worker_exception {
+        public:
+            explicit journal_exception(const char* msg) :
+                Worker_exception(msg) {};
+    };
+
+    /*!
+      \brief Class that appends records to the journal of a run of the
+             server.
+
+      The journal starts with a header: the magic string "WRKJNL01", the
+      start time of the run, the number of work items, and the length and
+      the name of the directory of the run that is resumed, if any, all
+      integers are 8 bytes.  It is followed by fixed size records.
+
+      Records are collected in memory and written by a thread of its own,
+      every commit interval, and synchronized to disk at once (group
+      commit), so the message loop neither waits for the filesystem, nor
+      pays for a system call per record.  A crash loses at most the
+      records of a single commit interval, and a partial record at the
+      end of the journal is ignored by the reader.
+     */
+    class Journal {
+        public:
+            /*!
+              \brief Journal constructor, writes the header, and starts the
+                     commit thread.
+              \param file_name std::string name of the journal file.
+              \param nr_items size_t number of work items of the run.
+              \param resumed_dir std::string directory of the run that is
+                     resumed, empty if none.
+              \param commit_interval time between commits.
+              \throw std::system_error if the file can not be created.
+             */
+            Journal(const std::string& file_name, size_t nr_items,
+                    const std::string& resumed_dir,
+                    std::chrono::milliseconds commit_interval);
+
+            /*!
+              \brief Journal destructor, commits the remaining records and
+                     stops the commit thread.
+             */
+            ~Journal();
+
+            Journal(const Journal&) = delete;
+            Journal& operator=(const Journal&) = delete;
+
+            /*!
+              \brief record that a work item was sent to a client.
+              \param work_id size_t ID of the work item.
+              \param client_id Uuid of the client.
+             */
+            void started(size_t work_id, const boost::uuids::uuid& client_id);
+
+            /*!
+              \brief record that the result of a work item was received.
+              \param work_id size_t ID of the work item.
+              \param exit_status int exit status of the work item.
+             */
+            void done(size_t work_id, int exit_status);
+
+            /*!
+              \brief record that the lease of a work item expired, and it
+                     was queued to be sent to another client.
+              \param work_id size_t ID of the work item.
+             */
+            void requeued(size_t work_id);
+
+            /*!
+              \brief record that a work item was killed since it exceeded
+                     its walltime limit, it precedes the done record.
+              \param work_id size_t ID of the work item.
+             */
+            void timed_out(size_t work_id);
+
+            /*!
+              \brief record that the run ended, all work items are done.
+             */
+            void end();
+
+        private:
+            int fd_;
+            const std::chrono::milliseconds commit_interval_;
+            //! protects the records, and the done flag
+            std::mutex mutex_;
+            std::condition_variable committable_;
+            //! encoded records that are not committed yet
+            std::string records_;
+            bool is_done_ {false};
+            //! number of each client that was recorded
+            std::map<boost::uuids::uuid, std::uint32_t> clients_;
+            std::thread thread_;
+            //! append a record, the caller holds the mutex
+            void append(Journal_event event, std::uint32_t value,
+                        size_t work_id);
+            //! function executed by the commit thread
+            void run();
+            //! write the records to the file, and synchronize it
+            void commit(const std::string& records);
+    };
+
+    /*!
+      \brief Class that reads a journal, also while it is written.
+
+      Records are read in batches, a subsequent read returns the records
+      that were committed since, so that a running job can be followed.
+     */
+    class Journal_reader {
+        public:
+            /*!
+              \brief Journal_reader constructor, reads the header.
+              \param file_name std::string name of the journal file.
+              \throw journal_exception if the file can not be opened, or
+                     is not a journal.
+             */
+            explicit Journal_reader(const std::string& file_name);
+
+            /*!
+              \brief Journal_reader destructor, closes the file.
+             */
+            ~Journal_reader();
+
+            Journal_reader(const Journal_reader&) = delete;
+            Journal_reader& operator=(const Journal_reader&) = delete;
+
+            /*!
+              \brief read the records appended since the previous read.
+              \param records std::vector<Journal_record>& that is replaced
+                     by the records that were read.
+              \param max_records size_t maximum number of records to read.
+              \return number of records read, 0 if there are no new
+                      complete records.
+             */
+            size_t read(std::vector<Journal_record>& records,
+                        size_t max_records);
+
+            /*!
+              \brief returns the start time of the run.
+              \return time in microseconds since the epoch.
+             */
+            std::int64_t start_time() const { return start_time_; };
+
+            /*!
+              \brief returns the number of work items of the run.
+              \return number of work items.
+             */
+            size_t nr_items() const { return nr_items_; };
+
+            /*!
+              \brief returns the directory of the run that was resumed.
+              \return directory name, empty if no run was resumed.
+             */
+            const std::string& resumed_dir() const { return resumed_dir_; };
+
+        private:
+            int fd_;
+            std::int64_t start_time_;
+            size_t nr_items_;
+            std::string resumed_dir_;
+            //! offset of the next record to read
+            size_t offset_;
+            std::vector<char> buffer_;
+    };
+
+}
+
+#endif
@@ -0,0 +1,60 @@
+#include <boost/uuid/uuid_generators.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "journal.h"
+
+/*
+  Write a journal for a number of work items, as the server would, and
+  time reading it back.  The journal can be summarized afterwards by
+  worker_journal.
+ */
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "### error: no journal file given" << std::endl;
+        return 1;
+    }
+    std::string file_name {argv[1]};
+    size_t nr_items = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 10000000;
+    const size_t nr_clients {64};
+    auto uuid_generator = boost::uuids::random_generator();
+    std::vector<boost::uuids::uuid> clients;
+    for (size_t i = 0; i < nr_clients; ++i)
+        clients.push_back(uuid_generator());
+
+    auto start = std::chrono::steady_clock::now();
+    {
+        worker::Journal journal(file_name, nr_items, "",
+                                std::chrono::milliseconds(100));
+        for (size_t work_id = 1; work_id <= nr_items; ++work_id) {
+            journal.started(work_id, clients[work_id % nr_clients]);
+            journal.done(work_id, work_id % 7 == 0 ? 1 : 0);
+        }
+        journal.end();
+    }
+    auto end = std::chrono::steady_clock::now();
+    std::cout << "write " << nr_items << " work items: "
+        << std::chrono::duration<double>(end - start).count() << " s"
+        << std::endl;
+
+    start = std::chrono::steady_clock::now();
+    worker::Journal_reader reader(file_name);
+    std::vector<worker::Journal_record> records;
+    size_t nr_records {0};
+    size_t nr_failed {0};
+    while (reader.read(records, 64*1024) > 0) {
+        nr_records += records.size();
+        for (const auto& record: records)
+            nr_failed += record.event == worker::Journal_event::done &&
+                         record.exit_status != 0;
+    }
+    end = std::chrono::steady_clock::now();
+    std::cout << "read " << nr_records << " records, " << nr_failed
+        << " failed: " << std::chrono::duration<double>(end - start).count()
+        << " s" << std::endl;
+    return 0;
+}
@@ -0,0 +1,128 @@
+#include <boost/filesystem.hpp>
+#include <boost/uuid/uuid_generators.hpp>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "journal.h"
+
+using Uuid = boost::uuids::uuid;
+
+const std::chrono::milliseconds commit_interval {10};
+
+// wait until the commit thread wrote the records
+void wait_for_commit() {
+    std::this_thread::sleep_for(10*commit_interval);
+}
+
+bool check(bool condition, const std::string& msg) {
+    if (!condition)
+        std::cerr << msg << std::endl;
+    return condition;
+}
+
+int main() {
+    auto uuid_generator = boost::uuids::random_generator();
+    Uuid client_a = uuid_generator();
+    Uuid client_b = uuid_generator();
+    auto file_name = (boost::filesystem::temp_directory_path() /
+                      boost::filesystem::unique_path("journal_%%%%%%%%.bin")).string();
+    std::vector<worker::Journal_record> records;
+    bool is_ok {true};
+    {
+        worker::Journal journal(file_name, 5, "/previous/run", commit_interval);
+        journal.started(1, client_a);
+        journal.started(2, client_b);
+        journal.started(3, client_a);
+        wait_for_commit();
+
+        // the header, and the records committed so far
+        worker::Journal_reader reader(file_name);
+        is_ok &= check(reader.nr_items() == 5, "number of items not read");
+        is_ok &= check(reader.resumed_dir() == "/previous/run",
+                       "resumed directory not read");
+        size_t nr_read = reader.read(records, 100);
+        std::cout << "read " << nr_read << " records" << std::endl;
+        // a client record precedes the first started record of a client
+        is_ok &= check(nr_read == 5, "records not committed");
+        if (nr_read == 5) {
+            is_ok &= check(records[0].event == worker::Journal_event::client &&
+                           records[0].client == 0 &&
+                           records[0].client_id == client_a,
+                           "first client record wrong");
+            is_ok &= check(records[1].event == worker::Journal_event::started &&
+                           records[1].client == 0 && records[1].work_id == 1,
+                           "first started record wrong");
+            is_ok &= check(records[2].event == worker::Journal_event::client &&
+                           records[2].client == 1 &&
+                           records[2].client_id == client_b,
+                           "second client record wrong");
+            is_ok &= check(records[3].work_id == 2 && records[3].client == 1,
+                           "second started record wrong");
+            is_ok &= check(records[4].event == worker::Journal_event::started &&
+                           records[4].client == 0 && records[4].work_id == 3,
+                           "client number not reused");
+        }
+        is_ok &= check(reader.read(records, 100) == 0,
+                       "records read twice");
+
+        // a subsequent read returns only the records committed since
+        journal.timed_out(2);
+        journal.done(2, 143);
+        journal.requeued(3);
+        journal.done(1, 0);
+        wait_for_commit();
+        nr_read = reader.read(records, 2);
+        std::cout << "read " << nr_read << " records" << std::endl;
+        is_ok &= check(nr_read == 2 &&
+                       records[0].event == worker::Journal_event::timed_out &&
+                       records[1].event == worker::Journal_event::done &&
+                       records[1].work_id == 2 && records[1].exit_status == 143,
+                       "incremental read wrong");
+        nr_read = reader.read(records, 100);
+        std::cout << "read " << nr_read << " records" << std::endl;
+        is_ok &= check(nr_read == 2 &&
+                       records[0].event == worker::Journal_event::requeued &&
+                       records[0].work_id == 3 &&
+                       records[1].event == worker::Journal_event::done &&
+                       records[1].work_id == 1 && records[1].exit_status == 0,
+                       "read after more commits wrong");
+        journal.end();
+    }
+
+    // the remaining records are committed when the journal is destroyed,
+    // a partial record at the end, e.g., of a crash, is not read until it
+    // is complete
+    {
+        std::ofstream file(file_name, std::ios::binary | std::ios::app);
+        file << std::string(10, 'd');
+    }
+    worker::Journal_reader reader(file_name);
+    size_t nr_records {0};
+    worker::Journal_event last_event {worker::Journal_event::client};
+    for (size_t nr_read; (nr_read = reader.read(records, 3)) > 0; ) {
+        nr_records += nr_read;
+        last_event = records.back().event;
+    }
+    std::cout << "read " << nr_records << " records in total" << std::endl;
+    is_ok &= check(nr_records == 10 && last_event == worker::Journal_event::end,
+                   "partial record not ignored");
+    {
+        std::ofstream file(file_name, std::ios::binary | std::ios::app);
+        file << std::string(14, '\0');
+    }
+    is_ok &= check(reader.read(records, 100) == 1 &&
+                   records[0].event == worker::Journal_event::done,
+                   "completed record not read");
+
+    try {
+        worker::Journal_reader not_journal("/dev/null");
+        is_ok &= check(false, "file that is not a journal read");
+    } catch (worker::journal_exception& err) {
+        std::cout << err.what() << std::endl;
+    }
+    boost::filesystem::remove(file_name);
+    return is_ok ? 0 : 1;
+}
@@ -0,0 +1,235 @@
+#include <boost/program_options.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "journal.h"
+#include "utils.h"
+#include "worker_exception.h"
+
+using Options = struct {
+    std::string journal_name;
+    bool is_follow;
+    long interval;
+    bool show_failed;
+    bool show_incomplete;
+};
+
+/*
+  The state of each work item is kept in arrays indexed by its ID, so a
+  record is processed in constant time, without allocations.  A work item
+  can be started more than once, its last start counts.
+ */
+struct Summary {
+    std::vector<std::int64_t> start_times;
+    std::vector<bool> is_done;
+    std::vector<size_t> failed;
+    std::vector<size_t> timed_out;
+    size_t nr_clients {0};
+    size_t nr_started {0};
+    size_t nr_done {0};
+    size_t nr_requeued {0};
+    size_t nr_timed {0};
+    std::int64_t first_time {std::numeric_limits<std::int64_t>::max()};
+    std::int64_t last_time {0};
+    std::int64_t min_walltime {std::numeric_limits<std::int64_t>::max()};
+    std::int64_t max_walltime {0};
+    double total_walltime {0.0};
+    bool is_ended {false};
+};
+
+// number of records read at once
+const size_t batch_size {64*1024};
+
+Options get_options(int argc, char* argv[]);
+void update(Summary& summary, const worker::Journal_record& record);
+void print_progress(const Summary& summary, size_t nr_items);
+void print_summary(const Summary& summary, const Options& options,
+        size_t nr_items);
+
+int main(int argc, char* argv[]) {
+    auto options = get_options(argc, argv);
+    std::unique_ptr<worker::Journal_reader> reader;
+    try {
+        reader = std::make_unique<worker::Journal_reader>(options.journal_name);
+    } catch (worker::journal_exception& err) {
+        std::cerr << "### error: " << err.what() << " '"
+            << options.journal_name << "'" << std::endl;
+        worker::exit(worker::Error::file);
+    }
+    Summary summary;
+    summary.start_times.resize(reader->nr_items() + 1);
+    summary.is_done.resize(reader->nr_items() + 1);
+    if (!reader->resumed_dir().empty())
+        std::cout << "resumed from: " << reader->resumed_dir() << std::endl;
+    std::vector<worker::Journal_record> records;
+    for (;;) {
+        while (reader->read(records, batch_size) > 0)
+            for (const auto& record: records)
+                update(summary, record);
+        if (!options.is_follow || summary.is_ended)
+            break;
+        print_progress(summary, reader->nr_items());
+        std::this_thread::sleep_for(std::chrono::milliseconds(options.interval));
+    }
+    print_summary(summary, options, reader->nr_items());
+    return 0;
+}
+
+Options get_options(int argc, char* argv[]) {
+    namespace po = boost::program_options;
+    Options options;
+    long default_interval {1000};
+
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("help,h", "produce help message")
+        ("version,v", "show software version")
+        ("journal", po::value<std::string>(&options.journal_name)->required(),
+         "journal file to read")
+        ("follow", po::bool_switch(&options.is_follow),
+         "follow a running job until it ends")
+        ("interval", po::value<long>(&options.interval)
+         ->default_value(default_interval),
+         "time between progress reports in ms when following a job")
+        ("show_failed", po::bool_switch(&options.show_failed),
+         "show work item IDs of failed items")
+        ("show_incomplete", po::bool_switch(&options.show_incomplete),
+         "show work item IDs of incomplete items")
+        ;
+    po::positional_options_description pos_desc;
+    pos_desc.add("journal", -1);
+    po::variables_map vm;
+    try {
+        po::store(po::command_line_parser(argc, argv)
+                .options(desc).positional(pos_desc).run(), vm);
+    } catch (boost::wrapexcept<boost::program_options::invalid_option_value>& err) {
+        std::cerr << "### error: " << err.what() << std::endl;
+        std::cerr << desc << std::endl;
+        worker::exit(worker::Error::cli_option);
+    } catch (boost::wrapexcept<boost::program_options::ambiguous_option>& err) {
+        std::cerr << "### error: " << err.what() << std::endl;
+        std::cerr << desc << std::endl;
+        worker::exit(worker::Error::cli_option);
+    }
+
+    if (vm.count("help")) {
+        std::cout << desc << std::endl;
+        std::exit(0);
+    }
+
+    if (vm.count("version")) {
+        print_version_info();
+        std::exit(0);
+    }
+
+    try {
+        po::notify(vm);
+    } catch (boost::wrapexcept<boost::program_options::required_option>& err) {
+        std::cerr << "### error: " << err.what() << std::endl;
+        std::cerr << desc << std::endl;
+        worker::exit(worker::Error::cli_option);
+    }
+
+    return options;
+}
+
+void update(Summary& summary, const worker::Journal_record& record) {
+    using worker::Journal_event;
+    if (record.event == Journal_event::client) {
+        ++summary.nr_clients;
+        return;
+    }
+    if (record.event == Journal_event::end) {
+        summary.is_ended = true;
+        summary.last_time = std::max(summary.last_time, record.time);
+        return;
+    }
+    if (record.work_id >= summary.start_times.size()) {
+        summary.start_times.resize(record.work_id + 1);
+        summary.is_done.resize(record.work_id + 1);
+    }
+    summary.first_time = std::min(summary.first_time, record.time);
+    summary.last_time = std::max(summary.last_time, record.time);
+    if (record.event == Journal_event::started) {
+        if (summary.start_times[record.work_id] == 0)
+            ++summary.nr_started;
+        summary.start_times[record.work_id] = record.time;
+    } else if (record.event == Journal_event::requeued) {
+        ++summary.nr_requeued;
+    } else if (record.event == Journal_event::timed_out &&
+               !summary.is_done[record.work_id]) {
+        summary.timed_out.push_back(record.work_id);
+    } else if (record.event == Journal_event::done &&
+               !summary.is_done[record.work_id]) {
+        summary.is_done[record.work_id] = true;
+        ++summary.nr_done;
+        if (record.exit_status != 0)
+            summary.failed.push_back(record.work_id);
+        if (summary.start_times[record.work_id] != 0) {
+            auto walltime = record.time - summary.start_times[record.work_id];
+            summary.min_walltime = std::min(summary.min_walltime, walltime);
+            summary.max_walltime = std::max(summary.max_walltime, walltime);
+            summary.total_walltime += walltime;
+            ++summary.nr_timed;
+        }
+    }
+}
+
+void print_progress(const Summary& summary, size_t nr_items) {
+    std::cout << "done: " << summary.nr_done << "/" << nr_items
+        << ", failed: " << summary.failed.size()
+        << ", running: " << summary.nr_started - summary.nr_done
+        << ", clients: " << summary.nr_clients << std::endl;
+}
+
+void print_summary(const Summary& summary, const Options& options,
+        size_t nr_items) {
+    std::cout << "work items: " << nr_items << std::endl;
+    std::cout << "success: " << summary.nr_done - summary.failed.size() << std::endl;
+    std::cout << "failure: " << summary.failed.size() << std::endl;
+    if (options.show_failed) {
+        auto failed = summary.failed;
+        std::sort(failed.begin(), failed.end());
+        std::cout << "\t";
+        for (auto work_id: failed)
+            std::cout << " " << work_id;
+        std::cout << std::endl;
+    }
+    std::cout << "timed out: " << summary.timed_out.size() << std::endl;
+    if (options.show_failed) {
+        auto timed_out = summary.timed_out;
+        std::sort(timed_out.begin(), timed_out.end());
+        std::cout << "\t";
+        for (auto work_id: timed_out)
+            std::cout << " " << work_id;
+        std::cout << std::endl;
+    }
+    std::cout << "incomplete: " << summary.nr_started - summary.nr_done << std::endl;
+    if (options.show_incomplete) {
+        std::cout << "\t";
+        for (size_t work_id = 1; work_id < summary.start_times.size(); ++work_id)
+            if (summary.start_times[work_id] != 0 && !summary.is_done[work_id])
+                std::cout << " " << work_id;
+        std::cout << std::endl;
+    }
+    std::cout << "requeued: " << summary.nr_requeued << std::endl;
+    std::cout << "clients: " << summary.nr_clients << std::endl;
+    std::cout << "job ended: " << (summary.is_ended ? "yes" : "no") << std::endl;
+    if (summary.nr_timed > 0) {
+        std::cout << std::fixed << std::setprecision(3);
+        std::cout << "elapsed time (s): "
+            << (summary.last_time - summary.first_time)/1.0e6 << std::endl;
+        std::cout << "workitem walltime (s): min "
+            << summary.min_walltime/1.0e6 << ", mean "
+            << summary.total_walltime/summary.nr_timed/1.0e6 << ", max "
+            << summary.max_walltime/1.0e6 << std::endl;
+    }
+}
@@ -1,7 +1,9 @@
+#include <algorithm>
 #include <boost/uuid/uuid_io.hpp>
 #include <sstream>
 
 #include "message.h"
+#include "wire.h"
 
 namespace worker {
     namespace message {
@@ -24,12 +26,62 @@ namespace worker {
         }
 
         Message Message_builder::build() {
-            Message msg(from_, to_, subject_, id_, content_);
+            Message msg(from_, to_, subject_, id_, std::move(content_));
             id_ = 0;
             content_ = std::string("");
             return msg;
         }
 
+        std::string encode_chunk(const Chunk& chunk) {
+            size_t size {8};
+            for (const auto& element: chunk)
+                size += 16 + element.second.length();
+            std::string str;
+            str.reserve(size);
+            wire::put_uint(str, chunk.size(), 8);
+            for (const auto& [id, content]: chunk) {
+                wire::put_uint(str, id, 8);
+                wire::put_uint(str, content.length(), 8);
+                str.append(content);
+            }
+            return str;
+        }
+
+        Chunk_view decode_chunk(std::string_view str) {
+            if (str.length() < 8)
+                throw message_parse_exception("can't read chunk size");
+            size_t nr_elements = wire::get_uint(str.data(), 8);
+            size_t pos {8};
+            Chunk_view chunk;
+            chunk.reserve(std::min(nr_elements, str.length()/16));
+            for (size_t i = 0; i < nr_elements; ++i) {
+                if (str.length() - pos < 16)
+                    throw message_parse_exception("can't read chunk element header");
+                size_t id = wire::get_uint(str.data() + pos, 8);
+                size_t length = wire::get_uint(str.data() + pos + 8, 8);
+                pos += 16;
+                if (str.length() - pos < length)
+                    throw message_parse_exception("can't read chunk element");
+                chunk.emplace_back(id, str.substr(pos, length));
+                pos += length;
+            }
+            return chunk;
+        }
+
+        std::string Message::header() const {
+            std::string header;
+            header.reserve(header_size);
+            wire::put_uint(header, wire::version, 1);
+            header.push_back(static_cast<char>(subject_));
+            header.append(reinterpret_cast<const char*>(from_.data),
+                          from_.size());
+            header.append(reinterpret_cast<const char*>(to_.data),
+                          to_.size());
+            wire::put_uint(header, id_, 8);
+            wire::put_uint(header, content_.length(), 8);
+            return header;
+        }
+
         using Uuid = boost::uuids::uuid;
 
         Message Message_builder::build(const std::string& str) const {
@@ -59,5 +111,23 @@ namespace worker {
             return Message(from, to, subject, id, content);
         }
 
+        Message Message_builder::build(std::string_view header,
+                                       std::string content) const {
+            if (header.length() != header_size)
+                throw message_parse_exception("invalid header size");
+            const char* data = header.data();
+            if (wire::get_uint(data, 1) != wire::version)
+                throw message_parse_exception("unsupported wire format version");
+            Subject subject = static_cast<Subject>(data[1]);
+            Uuid from;
+            std::copy(data + 2, data + 18, from.begin());
+            Uuid to;
+            std::copy(data + 18, data + 34, to.begin());
+            size_t id = wire::get_uint(data + 34, 8);
+            if (wire::get_uint(data + 42, 8) != content.length())
+                throw message_parse_exception("content length mismatch");
+            return Message(from, to, subject, id, std::move(content));
+        }
+
     }
 }
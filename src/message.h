@@ -3,6 +3,10 @@
 
 #include <boost/uuid/uuid.hpp>
 #include <iostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 #include "worker_exception.h"
 
@@ -16,11 +20,27 @@ namespace worker {
 
           Each message type is encoded by a single character, i.e.,
             * ack: a
-            * query: q
+            * query: q, the content is the number of work items
+              requested, a query without content requests a single one
             * result: r
+            * result_query: n, result that also requests a single work
+              item, the server replies with either work or stop, which
+              also acknowledges the result
+            * work_chunk: c, chunk of work items
+            * result_chunk: k, chunk of results
             * work: w
             * ack_stop: x
             * stop: s
+            * heartbeat: h, sent by a client to renew the leases of its
+              work items, the server replies with a heartbeat, when the
+              client reconnected, its content is a chunk of the IDs of
+              the work items it holds
+            * leave: l, the client leaves, its content is a chunk of the
+              IDs of the work items it finishes, the server replies with
+              an ack
+            * cancel: d, sent by the server when another client completed
+              the work item with the message's ID, the client stops it,
+              and doesn't send its result
             * invalid: i, used for initialization and ensuring that
               the message's subject is properly set.
          */
@@ -28,9 +48,15 @@ namespace worker {
             ack = 'a',
             query = 'q',
             result = 'r',
+            result_query = 'n',
+            work_chunk = 'c',
+            result_chunk = 'k',
             work = 'w',
             ack_stop = 'x',
             stop = 's',
+            heartbeat = 'h',
+            leave = 'l',
+            cancel = 'd',
             invalid = 'i'
         };
 
@@ -41,6 +67,15 @@ namespace worker {
           Messages have an origin, a destination, a subject, and content.
           To simplify decoding the messages, a message also includes the
           number of characters of the content.
+
+          On the wire, a message is sent as two frames: a fixed size
+          binary header and the content.  The header consists of
+            * the wire format version (1 byte),
+            * the subject (1 byte),
+            * the origin and destination UUIDs (16 bytes each),
+            * the ID (8 bytes, little endian),
+            * the length of the content (8 bytes, little endian).
+          The textual representation is used for logging.
          */
         class Message {
             friend class Message_builder;
@@ -49,18 +84,31 @@ namespace worker {
                 boost::uuids::uuid to() const { return to_; };
                 Subject subject() const { return subject_; };
                 size_t id() const { return id_; };
-                std::string content() const { return content_; };
+                const std::string& content() const { return content_; };
+                /*!
+                  \brief moves the content out of the message, e.g., to
+                         hand it to 0MQ without copying it.  The message's
+                         content is empty afterwards, so its header should
+                         be computed first.
+                  \return content of the message.
+                 */
+                std::string release_content() { return std::move(content_); };
                 size_t length() const { return content_.length(); };
                 std::string to_string() const;
+                /*!
+                  \brief returns the binary header of the message.
+                  \return header of header_size bytes.
+                 */
+                std::string header() const;
                 friend std::ostream& operator<<(std::ostream& out,
                         const Message& envelope);
             private:
                 Message(const boost::uuids::uuid& from,
                         const boost::uuids::uuid& to,
                         const Subject& subject, const size_t id,
-                        const std::string& str) :
+                        std::string str) :
                     from_ {from}, to_ {to}, subject_ {subject}, id_ {id},
-                          content_ {str} {};
+                          content_ {std::move(str)} {};
 
                 boost::uuids::uuid from_;
                 boost::uuids::uuid to_;
@@ -69,12 +117,46 @@ namespace worker {
                 std::string content_;
         };
 
+        /*!
+          \brief size of the binary message header in bytes.
+         */
+        const size_t header_size {1 + 1 + 16 + 16 + 8 + 8};
+
         class message_parse_exception : public Worker_exception {
             public:
                 explicit message_parse_exception(const char* msg) :
                     Worker_exception(msg) {};
         };
 
+        /*!
+          \brief work items or results that are sent in a single message,
+                 each identified by its work item ID.
+         */
+        using Chunk = std::vector<std::pair<size_t, std::string>>;
+
+        /*!
+          \brief decoded chunk, its elements refer to the message content
+                 it was decoded from, so that content has to outlive it.
+         */
+        using Chunk_view = std::vector<std::pair<size_t, std::string_view>>;
+
+        /*!
+          \brief encode a chunk as message content, i.e., the number of
+                 elements, followed by the ID, the length and the bytes of
+                 each element, all integers are 8 bytes, little endian.
+          \param chunk Chunk to encode.
+          \return string representation of the chunk.
+         */
+        std::string encode_chunk(const Chunk& chunk);
+
+        /*!
+          \brief decode message content into a chunk, without copying
+                 its elements.
+          \param str std::string_view representation of the chunk.
+          \return decoded chunk, referring to str.
+         */
+        Chunk_view decode_chunk(std::string_view str);
+
         class Message_builder {
             public:
                 explicit Message_builder(boost::uuids::uuid process_id) :
@@ -91,12 +173,24 @@ namespace worker {
                     id_ = id;
                     return *this;
                 };
-                Message_builder& content(const std::string& str) {
-                    content_ = str;
+                Message_builder& content(std::string str) {
+                    content_ = std::move(str);
                     return *this;
                 };
                 Message build();
                 Message build(const std::string& str) const;
+                /*!
+                  \brief build a message from its wire representation.
+                  \param header std::string_view binary message header.
+                  \param content std::string message content, moved into
+                         the message.
+                  \return message.
+                  \throw message_parse_exception if the header is
+                         malformed, has an unsupported version, or does
+                         not match the content.
+                 */
+                Message build(std::string_view header,
+                              std::string content) const;
             private:
                 boost::uuids::uuid from_;
                 boost::uuids::uuid to_;
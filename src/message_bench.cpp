@@ -0,0 +1,74 @@
+#include <boost/uuid/uuid_generators.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "message.h"
+#include "work_processor/result.h"
+
+namespace wm = worker::message;
+namespace wpr = worker::work_processor;
+
+using Uuid = boost::uuids::uuid;
+
+/*
+  Compare the cost of encoding and decoding a result message in the
+  textual format and in the binary wire format.  A round trip encodes
+  a result, wraps it in a message, serializes the message, and decodes
+  both again, as the client and the server would.
+ */
+
+double time_text(const wm::Message_builder& decoder, wm::Message_builder& builder,
+                 const Uuid& to, const wpr::Result& result, int nr_iters) {
+    size_t check {0};
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < nr_iters; ++i) {
+        auto msg = builder.to(to).subject(wm::Subject::result).id(i)
+                          .content(result.to_string()).build();
+        auto decoded = decoder.build(msg.to_string());
+        wpr::Result decoded_result(decoded.content());
+        check += decoded_result.stdout().length();
+    }
+    auto end = std::chrono::steady_clock::now();
+    if (check != nr_iters*result.stdout().length())
+        std::cerr << "### error: text round trip failed" << std::endl;
+    return std::chrono::duration<double, std::micro>(end - start).count()/nr_iters;
+}
+
+double time_binary(const wm::Message_builder& decoder, wm::Message_builder& builder,
+                   const Uuid& to, const wpr::Result& result, int nr_iters) {
+    size_t check {0};
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < nr_iters; ++i) {
+        auto msg = builder.to(to).subject(wm::Subject::result).id(i)
+                          .content(result.encode()).build();
+        auto header = msg.header();
+        auto decoded = decoder.build(header, msg.content());
+        auto decoded_result = wpr::Result::decode(decoded.content());
+        check += decoded_result.stdout().length();
+    }
+    auto end = std::chrono::steady_clock::now();
+    if (check != nr_iters*result.stdout().length())
+        std::cerr << "### error: binary round trip failed" << std::endl;
+    return std::chrono::duration<double, std::micro>(end - start).count()/nr_iters;
+}
+
+int main(int argc, char* argv[]) {
+    int nr_iters = argc > 1 ? std::atoi(argv[1]) : 100000;
+    auto uuid_generator = boost::uuids::random_generator();
+    Uuid from = uuid_generator();
+    Uuid to = uuid_generator();
+    wm::Message_builder builder(from);
+    wm::Message_builder decoder(to);
+    std::cout << "output size\ttext (us)\tbinary (us)" << std::endl;
+    for (size_t size: {0, 100, 10000, 1000000}) {
+        wpr::Result result(0, std::string(size, 'x'), "warning\n");
+        int iters = size >= 1000000 ? std::max(1, nr_iters/1000) : nr_iters;
+        double text_time = time_text(decoder, builder, to, result, iters);
+        double binary_time = time_binary(decoder, builder, to, result, iters);
+        std::cout << size << "\t" << text_time << "\t" << binary_time
+                  << std::endl;
+    }
+    return 0;
+}
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <boost/uuid/uuid_generators.hpp>
 #include <iostream>
 #include <sstream>
@@ -27,5 +28,35 @@ int main() {
         std::cout << e.what() << std::endl;
     }
     std::cout << message << std::endl;
+
+    // round trip through the binary wire format
+    auto header = message.header();
+    auto decoded = builder.build(header, message.content());
+    std::cout << decoded << std::endl;
+    if (decoded.to_string() != message.to_string()) {
+        std::cerr << "binary round trip failed" << std::endl;
+        return 1;
+    }
+    header[0] = 0;
+    try {
+        builder.build(header, message.content());
+        std::cerr << "wire format version not checked" << std::endl;
+        return 1;
+    } catch (wm::message_parse_exception& e) {
+        std::cout << e.what() << std::endl;
+    }
+
+    // round trip of a chunk, with content that contains separators
+    wm::Chunk chunk {{3, "echo 1"}, {5, ""}, {8, std::string("a\0 b\n", 5)}};
+    auto encoded_chunk = wm::encode_chunk(chunk);
+    auto decoded_chunk = wm::decode_chunk(encoded_chunk);
+    if (!std::equal(chunk.begin(), chunk.end(), decoded_chunk.begin(),
+                    decoded_chunk.end(), [] (const auto& a, const auto& b) {
+                        return a.first == b.first && a.second == b.second;
+                    })) {
+        std::cerr << "chunk round trip failed" << std::endl;
+        return 1;
+    }
+    std::cout << "chunk of " << chunk.size() << " elements" << std::endl;
     return 0;
 }
@@ -0,0 +1,262 @@
+#include <boost/filesystem.hpp>
+#include <boost/log/trivial.hpp>
+#include <fstream>
+#include <system_error>
+#include <vector>
+
+#include "output_writer.h"
+
+namespace worker {
+
+    namespace wpr = work_processor;
+
+    // number of bytes of output a queued result accounts for
+    static size_t output_size(const wpr::Result& result) {
+        return result.stdout().length() + result.stderr().length();
+    }
+
+    Output_writer::Output_writer(std::ostream& out, std::ostream& err,
+                                 std::ostream& index, std::ostream* usage,
+                                 size_t max_queued_size,
+                                 std::chrono::milliseconds flush_interval,
+                                 bool is_ordered, size_t max_reorder_size) :
+        out_ {out}, err_ {err}, index_ {index}, usage_ {usage},
+        max_queued_size_ {max_queued_size}, flush_interval_ {flush_interval},
+        is_ordered_ {is_ordered}, max_reorder_size_ {max_reorder_size} {
+        if (is_ordered_) {
+            reorder_file_name_ = (boost::filesystem::temp_directory_path() /
+                    boost::filesystem::unique_path("worker_reorder_%%%%-%%%%-%%%%")
+                ).string();
+            reorder_file_.open(reorder_file_name_, std::ios::in | std::ios::out |
+                               std::ios::trunc | std::ios::binary);
+            if (reorder_file_.fail())
+                throw std::system_error(errno, std::generic_category(),
+                                        "can not create reorder file");
+        }
+        thread_ = std::thread(&Output_writer::run, this);
+    }
+
+    Output_writer::~Output_writer() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            is_done_ = true;
+        }
+        queued_.notify_one();
+        thread_.join();
+        if (is_ordered_) {
+            BOOST_LOG_TRIVIAL(info) << "reorder buffer moved "
+                << nr_reorder_spills_ << " results to disk";
+            reorder_file_.close();
+            boost::system::error_code err;
+            boost::filesystem::remove(reorder_file_name_, err);
+        }
+    }
+
+    void Output_writer::write(size_t work_id, wpr::Result&& result) {
+        size_t size = output_size(result);
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            room_.wait(lock, [this, size] {
+                return queue_.empty() ||
+                    queued_size_ + size <= max_queued_size_;
+            });
+            queue_.emplace_back(work_id, std::move(result));
+            queued_size_ += size;
+        }
+        queued_.notify_one();
+    }
+
+    void Output_writer::skip(std::vector<bool> completed) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        completed_ = std::move(completed);
+    }
+
+    void Output_writer::run() {
+        auto last_flush = std::chrono::steady_clock::now();
+        bool is_flushed {true};
+        for (;;) {
+            std::deque<Item> items;
+            bool is_done;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                queued_.wait_for(lock, flush_interval_, [this] {
+                    return is_done_ || !queue_.empty();
+                });
+                items.swap(queue_);
+                queued_size_ = 0;
+                is_done = is_done_;
+            }
+            room_.notify_all();
+            for (auto& item: items) {
+                if (is_ordered_)
+                    reorder(item);
+                else
+                    write_result(item.first, item.second);
+            }
+            if (is_done && !reorder_buffer_.empty()) {
+                // results that never arrived can't hold back the others
+                BOOST_LOG_TRIVIAL(warning) << "results before work item "
+                    << reorder_buffer_.begin()->first << " are missing";
+                for (const auto& [work_id, result]: reorder_buffer_)
+                    write_result(work_id, result);
+                reorder_buffer_.clear();
+            }
+            if (!items.empty())
+                is_flushed = false;
+            auto now = std::chrono::steady_clock::now();
+            if (is_done || (!is_flushed && now - last_flush >= flush_interval_)) {
+                out_.flush();
+                err_.flush();
+                index_.flush();
+                if (usage_)
+                    usage_->flush();
+                if (out_.fail() || err_.fail() || index_.fail() ||
+                        (usage_ && usage_->fail()))
+                    BOOST_LOG_TRIVIAL(error) << "could not write output";
+                last_flush = now;
+                is_flushed = true;
+            }
+            if (is_done && items.empty())
+                return;
+        }
+    }
+
+    void Output_writer::advance_next_id() {
+        while (next_id_ < completed_.size() && completed_[next_id_])
+            ++next_id_;
+    }
+
+    void Output_writer::reorder(Item& item) {
+        auto& [work_id, result] = item;
+        advance_next_id();
+        if (work_id != next_id_) {
+            reorder_size_ += output_size(result);
+            reorder_buffer_.emplace(work_id, std::move(result));
+            if (reorder_size_ > max_reorder_size_)
+                spill_reorder_buffer();
+            return;
+        }
+        write_result(work_id, result);
+        ++next_id_;
+        advance_next_id();
+        for (auto it = reorder_buffer_.begin();
+                it != reorder_buffer_.end() && it->first == next_id_;
+                it = reorder_buffer_.erase(it)) {
+            reorder_size_ -= output_size(it->second);
+            write_result(it->first, it->second);
+            ++next_id_;
+            advance_next_id();
+        }
+    }
+
+    void Output_writer::spill_reorder_buffer() {
+        // the results that are furthest ahead are needed last
+        for (auto it = reorder_buffer_.rbegin();
+                it != reorder_buffer_.rend() && reorder_size_ > max_reorder_size_;
+                ++it) {
+            auto& result = it->second;
+            size_t size = output_size(result);
+            if (size == 0)
+                continue;
+            // move the output kept in memory, and the client's spill file,
+            // if any, to the end of the reorder file, when that fails, the
+            // result is kept as it is, and nothing else is moved
+            wpr::Output_file files[2];
+            const std::string* outputs[] = {&result.stdout(), &result.stderr()};
+            const wpr::Output_file* spills[] = {&result.stdout_file(),
+                                                &result.stderr_file()};
+            bool is_written {true};
+            reorder_file_.clear();
+            for (int i = 0; i < 2 && is_written; ++i) {
+                reorder_file_.seekp(0, std::ios::end);
+                auto offset = reorder_file_.tellp();
+                is_written = offset >= 0 &&
+                    write_output(reorder_file_, *outputs[i], *spills[i], false);
+                files[i] = {reorder_file_name_, static_cast<size_t>(offset),
+                            outputs[i]->length() + spills[i]->length};
+            }
+            if (!is_written || !reorder_file_.flush()) {
+                BOOST_LOG_TRIVIAL(error) << "could not write reorder file, "
+                    << "output kept in memory";
+                return;
+            }
+            boost::system::error_code err;
+            for (const auto* spill: spills)
+                if (!spill->name.empty())
+                    boost::filesystem::remove(spill->name, err);
+            result = wpr::Result(result.exit_status(), "", "",
+                                 std::move(files[0]), std::move(files[1]),
+                                 false, result.usage(),
+                                 result.is_timed_out());
+            reorder_size_ -= size;
+            ++nr_reorder_spills_;
+        }
+    }
+
+    void Output_writer::write_result(size_t work_id, const wpr::Result& result) {
+        if (usage_) {
+            const auto& usage = result.usage();
+            *usage_ << work_id << "\t" << result.exit_status() << "\t"
+                << usage.walltime << "\t" << usage.user_time << "\t"
+                << usage.system_time << "\t" << usage.max_rss << "\t"
+                << usage.read_blocks << "\t" << usage.write_blocks << "\n";
+        }
+        if (result.is_stored()) {
+            // the client wrote the output, only record where
+            const auto& out_file = result.stdout_file();
+            const auto& err_file = result.stderr_file();
+            index_ << work_id << "\t" << result.exit_status() << "\t"
+                << out_file.name << "\t" << out_file.offset << "\t"
+                << out_file.length << "\t"
+                << err_file.name << "\t" << err_file.offset << "\t"
+                << err_file.length << "\n";
+        } else {
+            write_output(out_, result.stdout(), result.stdout_file());
+            out_ << "\n";
+            write_output(err_, result.stderr(), result.stderr_file());
+            err_ << "\n";
+        }
+    }
+
+    bool Output_writer::write_output(std::ostream& out, const std::string& output,
+                                     const wpr::Output_file& file,
+                                     bool is_removed) {
+        out << output;
+        if (file.name.empty())
+            return true;
+        // output in a file, either spilled by the client, or moved out of
+        // the reorder buffer, is copied block by block
+        bool is_reorder_file {file.name == reorder_file_name_};
+        std::ifstream spill;
+        std::istream* in {&reorder_file_};
+        if (!is_reorder_file) {
+            spill.open(file.name, std::ios::binary);
+            in = &spill;
+        }
+        if (in->fail()) {
+            BOOST_LOG_TRIVIAL(error) << "could not open spill file '"
+                << file.name << "'";
+            return false;
+        }
+        in->clear();
+        in->seekg(file.offset);
+        std::vector<char> buffer(std::min<size_t>(file.length, 1024*1024));
+        size_t nr_copied {0};
+        while (nr_copied < file.length &&
+                in->read(buffer.data(), std::min(buffer.size(),
+                                                 file.length - nr_copied))) {
+            out.write(buffer.data(), in->gcount());
+            nr_copied += in->gcount();
+        }
+        if (nr_copied < file.length)
+            BOOST_LOG_TRIVIAL(error) << "could not read spill file '"
+                << file.name << "'";
+        if (!is_reorder_file && is_removed) {
+            spill.close();
+            boost::system::error_code err;
+            boost::filesystem::remove(file.name, err);
+        }
+        return nr_copied == file.length;
+    }
+
+}
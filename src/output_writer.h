@@ -0,0 +1,152 @@
+/*!
+  \file
+  \brief Asynchronous writer for the results of work items
+ */
+#ifndef OUTPUT_WRITER_HDR
+#define OUTPUT_WRITER_HDR
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "work_processor/result.h"
+
+namespace worker {
+
+    /*!
+      \brief Class that writes results of work items in a thread of its
+             own, so that the server's message loop doesn't wait for the
+             filesystem.
+
+      Results are queued by the message loop, and written by the writer
+      thread to the output, error and index streams, and their resource
+      usage to the usage stream, if any.  The queue is bounded
+      by the size of the output it holds, when it is full, the message
+      loop blocks until the writer catches up.  The streams are flushed
+      periodically, rather than for each result.
+
+      In ordered mode, results are written in the order of their work
+      item IDs.  Results that arrive early are kept in a reorder buffer,
+      when the output they hold exceeds its maximum size, the output of
+      the results that are furthest ahead is moved to a temporary file.
+     */
+    class Output_writer {
+        public:
+            /*!
+              \brief Output_writer constructor, starts the writer thread.
+              \param out std::ostream& stream for standard output.
+              \param err std::ostream& stream for standard error.
+              \param index std::ostream& stream for the location of output
+                     stored by clients.
+              \param usage std::ostream* stream for the resource usage of
+                     work items, nullptr if it is not recorded.
+              \param max_queued_size size_t maximum number of bytes of
+                     output in the queue, a single result is accepted
+                     regardless of its size.
+              \param flush_interval time between flushes of the streams.
+              \param is_ordered bool true if results are to be written in
+                     the order of their work item IDs.
+              \param max_reorder_size size_t maximum number of bytes of
+                     output kept in memory by the reorder buffer.
+              \throw std::system_error if the temporary file for the
+                     reorder buffer can not be created.
+             */
+            Output_writer(std::ostream& out, std::ostream& err,
+                          std::ostream& index, std::ostream* usage,
+                          size_t max_queued_size,
+                          std::chrono::milliseconds flush_interval,
+                          bool is_ordered, size_t max_reorder_size);
+
+            /*!
+              \brief Output_writer destructor, writes the queued results,
+                     flushes the streams and stops the writer thread.
+             */
+            ~Output_writer();
+
+            Output_writer(const Output_writer&) = delete;
+            Output_writer& operator=(const Output_writer&) = delete;
+
+            /*!
+              \brief queue a result for writing, blocks while the queue is
+                     full.
+              \param work_id size_t ID of the work item.
+              \param result Result to write, moved into the queue.
+             */
+            void write(size_t work_id, work_processor::Result&& result);
+
+            /*!
+              \brief set the work items that were completed before, in
+                     ordered mode, their results are not waited for.
+                     Should be called before the first result is written.
+              \param completed std::vector<bool> with an element set for
+                     each ID of a completed work item.
+             */
+            void skip(std::vector<bool> completed);
+
+        private:
+            using Item = std::pair<size_t, work_processor::Result>;
+            std::ostream& out_;
+            std::ostream& err_;
+            std::ostream& index_;
+            std::ostream* usage_;
+            const size_t max_queued_size_;
+            const std::chrono::milliseconds flush_interval_;
+            //! protects the queue, its size and the done flag
+            std::mutex mutex_;
+            //! signals the writer that results are queued
+            std::condition_variable queued_;
+            //! signals the message loop that the queue has room
+            std::condition_variable room_;
+            std::deque<Item> queue_;
+            size_t queued_size_ {0};
+            bool is_done_ {false};
+
+            std::thread thread_;
+            //! true if results are written in order of their IDs
+            const bool is_ordered_;
+            const size_t max_reorder_size_;
+            //! results that arrived before their predecessors
+            std::map<size_t, work_processor::Result> reorder_buffer_;
+            //! number of bytes of output in memory in the reorder buffer
+            size_t reorder_size_ {0};
+            //! ID of the next result to write in ordered mode
+            size_t next_id_ {1};
+            //! work items completed before, indexed by ID
+            std::vector<bool> completed_;
+            //! number of results moved out of the reorder buffer
+            size_t nr_reorder_spills_ {0};
+            //! temporary file for output moved out of the reorder buffer
+            std::string reorder_file_name_;
+            std::fstream reorder_file_;
+            //! function executed by the writer thread
+            void run();
+            //! add a result to the reorder buffer, and write the results
+            //! that are next in line
+            void reorder(Item& item);
+            //! advance to the next ID that was not completed before
+            void advance_next_id();
+            //! move output of the results that are furthest ahead out of
+            //! memory until the reorder buffer is within its bounds
+            void spill_reorder_buffer();
+            //! write a single result to the streams
+            void write_result(size_t work_id,
+                              const work_processor::Result& result);
+            //! write output kept in memory, followed by output in a file,
+            //! a spill file of a client is removed, unless is_removed is
+            //! false, returns false if the file could not be read
+            bool write_output(std::ostream& out, const std::string& output,
+                              const work_processor::Output_file& file,
+                              bool is_removed = true);
+    };
+
+}
+
+#endif
@@ -0,0 +1,144 @@
+#include <boost/filesystem.hpp>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "output_writer.h"
+
+namespace wpr = worker::work_processor;
+
+const std::chrono::milliseconds flush_interval {10};
+const size_t max_queued_size {1024};
+
+// wait until the writer thread handled the queued results
+void wait_for_writer() {
+    std::this_thread::sleep_for(10*flush_interval);
+}
+
+bool check(bool condition, const std::string& msg) {
+    if (!condition)
+        std::cerr << msg << std::endl;
+    return condition;
+}
+
+wpr::Result result(size_t work_id) {
+    return wpr::Result(0, "out " + std::to_string(work_id),
+                       "err " + std::to_string(work_id));
+}
+
+// expected output of the given work items, in that order
+std::string expected(const std::vector<size_t>& work_ids,
+                     const std::string& prefix) {
+    std::string output;
+    for (auto work_id: work_ids)
+        output += prefix + " " + std::to_string(work_id) + "\n";
+    return output;
+}
+
+int main() {
+    bool is_ok {true};
+
+    // results are written as they arrive when the order doesn't matter
+    {
+        std::stringstream out, err, index;
+        {
+            worker::Output_writer writer(out, err, index, nullptr,
+                                         max_queued_size, flush_interval,
+                                         false, max_queued_size);
+            writer.write(2, result(2));
+            writer.write(1, result(1));
+        }
+        std::cout << "unordered: " << out.str();
+        is_ok &= check(out.str() == expected({2, 1}, "out") &&
+                       err.str() == expected({2, 1}, "err"),
+                       "unordered output wrong");
+    }
+
+    // results that arrive early wait for their predecessors
+    {
+        std::stringstream out, err, index;
+        {
+            worker::Output_writer writer(out, err, index, nullptr,
+                                         max_queued_size, flush_interval,
+                                         true, max_queued_size);
+            writer.write(3, result(3));
+            writer.write(1, result(1));
+            wait_for_writer();
+            is_ok &= check(out.str() == expected({1}, "out"),
+                           "result written before its predecessor");
+            writer.write(2, result(2));
+        }
+        std::cout << "out of order: " << out.str();
+        is_ok &= check(out.str() == expected({1, 2, 3}, "out") &&
+                       err.str() == expected({1, 2, 3}, "err"),
+                       "out of order output wrong");
+    }
+
+    // work items completed before, e.g., when resuming, are not waited for
+    {
+        std::stringstream out, err, index;
+        {
+            worker::Output_writer writer(out, err, index, nullptr,
+                                         max_queued_size, flush_interval,
+                                         true, max_queued_size);
+            writer.skip({false, true, false, true, false, false});
+            writer.write(5, result(5));
+            writer.write(4, result(4));
+            writer.write(2, result(2));
+        }
+        std::cout << "skipped: " << out.str();
+        is_ok &= check(out.str() == expected({2, 4, 5}, "out"),
+                       "skipped output wrong");
+    }
+
+    // results are moved out of memory when the reorder buffer is full,
+    // including the client's spill file, that is removed once copied
+    {
+        auto spill_name = (boost::filesystem::temp_directory_path() /
+                           boost::filesystem::unique_path("spill_%%%%%%%%")).string();
+        {
+            std::ofstream spill(spill_name, std::ios::binary);
+            spill << " and more";
+        }
+        std::stringstream out, err, index;
+        {
+            worker::Output_writer writer(out, err, index, nullptr,
+                                         max_queued_size, flush_interval,
+                                         true, 1);
+            writer.write(3, wpr::Result(0, "out 3", "err 3",
+                                        {spill_name, 0, 9}, {}, false));
+            writer.write(2, result(2));
+            wait_for_writer();
+            is_ok &= check(!boost::filesystem::exists(spill_name),
+                           "spill file not moved to reorder file");
+            writer.write(1, result(1));
+        }
+        std::cout << "spilled: " << out.str();
+        is_ok &= check(out.str() == "out 1\nout 2\nout 3 and more\n" &&
+                       err.str() == expected({1, 2, 3}, "err"),
+                       "spilled output wrong");
+        boost::filesystem::remove(spill_name);
+    }
+
+    // results that never arrived don't hold back the others at shutdown,
+    // whether they are in memory or moved to disk
+    for (size_t max_reorder_size: {max_queued_size, size_t {1}}) {
+        std::stringstream out, err, index;
+        {
+            worker::Output_writer writer(out, err, index, nullptr,
+                                         max_queued_size, flush_interval,
+                                         true, max_reorder_size);
+            writer.write(4, result(4));
+            writer.write(2, result(2));
+        }
+        std::cout << "missing: " << out.str();
+        is_ok &= check(out.str() == expected({2, 4}, "out") &&
+                       err.str() == expected({2, 4}, "err"),
+                       "missing results hold back output");
+    }
+
+    return is_ok ? 0 : 1;
+}
@@ -1,6 +1,9 @@
 #include <fstream>
 #include <iostream>
+#include <limits>
+#include <vector>
 
+#include "work_parser/work_file.h"
 #include "work_parser/work_parser.h"
 
 namespace wp = worker::work_parser;
@@ -21,5 +24,91 @@ int main(int argc, char* argv[]) {
         std::cout << "# item " << parser.nr_items() << std::endl;
         std::cout << parser.next() << std::endl;
     }
+
+    // the indexed work file should have the same work items, also when
+    // accessed in reverse order
+    wp::Work_file work_file(file_name);
+    std::cout << "# index " << (work_file.is_index_cached() ? "cached" : "built")
+              << ", " << work_file.nr_items() << " items" << std::endl;
+    if (work_file.nr_items() != parser.nr_items()) {
+        std::cerr << "### error: number of items differs" << std::endl;
+        return 1;
+    }
+    for (size_t id = work_file.nr_items(); id > 0; --id) {
+        std::ifstream item_ifs(file_name);
+        wp::Work_parser item_parser(item_ifs);
+        std::string item;
+        while (item_parser.nr_items() < id)
+            item = item_parser.next();
+        // the stream parser terminates the last line of a work item
+        auto view = work_file.item(id);
+        if (view != item && std::string(view) + "\n" != item) {
+            std::cerr << "### error: item " << id << " differs" << std::endl;
+            return 1;
+        }
+    }
+
+    // when the odd work items are completed, only the even ones are
+    // returned, with their original IDs
+    wp::Work_parser skip_parser(work_file);
+    std::vector<bool> completed(work_file.nr_items() + 1);
+    for (size_t id = 1; id < completed.size(); id += 2)
+        completed[id] = true;
+    skip_parser.skip(completed);
+    size_t nr_returned {0};
+    while (skip_parser.has_next()) {
+        auto item = skip_parser.next();
+        ++nr_returned;
+        if (skip_parser.nr_items() % 2 != 0 ||
+                item != work_file.item(skip_parser.nr_items())) {
+            std::cerr << "### error: item " << skip_parser.nr_items()
+                      << " not skipped" << std::endl;
+            return 1;
+        }
+    }
+    if (nr_returned + skip_parser.nr_skipped() != work_file.nr_items()) {
+        std::cerr << "### error: number of skipped items differs" << std::endl;
+        return 1;
+    }
+
+    // prioritized work items are returned longest first, those without
+    // an estimate take the mean, and the odd ones remain skipped
+    wp::Work_parser priority_parser(work_file);
+    priority_parser.skip(completed);
+    std::vector<double> estimates(work_file.nr_items() + 1, -1.0);
+    double total_estimate {0.0};
+    size_t nr_estimates {0};
+    for (size_t id = 4; id < estimates.size(); id += 4) {
+        estimates[id] = static_cast<double>(id);
+        total_estimate += estimates[id];
+        ++nr_estimates;
+    }
+    priority_parser.prioritize(estimates);
+    for (auto& estimate: estimates)
+        if (estimate < 0.0)
+            estimate = nr_estimates > 0 ? total_estimate/nr_estimates : 0.0;
+    double previous_estimate {std::numeric_limits<double>::max()};
+    size_t previous_id {0};
+    nr_returned = 0;
+    while (priority_parser.has_next()) {
+        auto item = priority_parser.next();
+        size_t id = priority_parser.nr_items();
+        ++nr_returned;
+        double estimate = estimates[id];
+        if (id % 2 != 0 || item != work_file.item(id) ||
+                estimate > previous_estimate ||
+                (estimate == previous_estimate && id < previous_id)) {
+            std::cerr << "### error: item " << id << " out of order"
+                      << std::endl;
+            return 1;
+        }
+        previous_estimate = estimate;
+        previous_id = id;
+    }
+    if (nr_returned != priority_parser.nr_provided() ||
+            nr_returned + priority_parser.nr_skipped() != work_file.nr_items()) {
+        std::cerr << "### error: number of prioritized items differs" << std::endl;
+        return 1;
+    }
     return 0;
 }
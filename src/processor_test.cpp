@@ -1,3 +1,5 @@
+#include <boost/process/environment.hpp>
+#include <cstring>
 #include <iostream>
 #include <sstream>
 
@@ -5,20 +7,39 @@
 
 namespace wpr = worker::work_processor;
 
-int main() {
-    std::stringstream work_item;
-    std::string line;
-    while (std::getline(std::cin, line))
-        work_item << line << std::endl;
-    std::cout << "work:" << std::endl;
-    std::cout << work_item.str() << std::endl;
-    auto result = wpr::process_work(work_item.str());
+void print_result(const wpr::Result& result) {
     std::cout << "result:" << std::endl;
     std::cout << "\texit code: " << result.exit_status() << std::endl;
+    const auto& usage = result.usage();
+    std::cout << "\twalltime: " << usage.walltime << " us, user: "
+        << usage.user_time << " us, system: " << usage.system_time
+        << " us, max RSS: " << usage.max_rss << " KB, blocks read: "
+        << usage.read_blocks << ", written: " << usage.write_blocks
+        << std::endl;
     std::cout << "##### stdout #####" << std::endl;
     std::cout << result.stdout() << std::endl;
     std::cout << "##### stder #####" << std::endl;
     std::cout << result.stderr() << std::endl;
     std::cout << "#####" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    std::stringstream work_item;
+    std::string line;
+    while (std::getline(std::cin, line))
+        work_item << line << std::endl;
+    std::cout << "work:" << std::endl;
+    std::cout << work_item.str() << std::endl;
+    // with --persistent, the work item runs twice in the same shell, the
+    // second run should not see changes the first made to its environment
+    if (argc > 1 && std::strcmp(argv[1], "--persistent") == 0) {
+        wpr::Output_options output_options;
+        wpr::Shell shell(boost::this_process::environment(), output_options,
+                         true);
+        print_result(shell.run(work_item.str(), 1));
+        print_result(shell.run(work_item.str(), 2));
+    } else {
+        print_result(wpr::process_work(work_item.str()));
+    }
     return 0;
 }
@@ -5,17 +5,33 @@
 #include <boost/program_options.hpp>
 #include <boost/uuid/uuid_generators.hpp>
 #include <boost/uuid/uuid_io.hpp>
+#include <algorithm>
+#include <charconv>
 #include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <deque>
 #include <fstream>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <optional>
 #include <set>
+#include <stdexcept>
+#include <string_view>
+#include <system_error>
 #include <thread>
+#include <vector>
 #include <zmq.hpp>
 
+#include "journal.h"
 #include "message.h"
+#include "output_writer.h"
 #include "utils.h"
 #include "worker_exception.h"
+#include "work_parser/work_file.h"
 #include "work_parser/work_parser.h"
+#include "work_processor/directives.h"
 #include "work_processor/result.h"
 
 using Options = struct {
@@ -24,15 +40,153 @@ using Options = struct {
     int port_nr;
     std::string out_name;
     std::string err_name;
+    std::string index_name;
     std::string log_name;
+    boost::log::trivial::severity_level log_level;
     long wait_time;
+    size_t max_chunk_size;
+    bool is_ordered;
+    size_t max_reorder_size;
+    std::string resume_dir;
+    bool is_redo;
+    bool is_longest_first;
+    std::string estimates_dir;
+    std::string journal_name;
+    std::string usage_name;
+    long lease_time;
+    size_t max_copies;
+    size_t max_attempts;
+    std::string retry_exit_codes;
+    long retry_backoff;
+    bool is_retry_elsewhere;
 };
 
 using Uuid = boost::uuids::uuid;
 
-void print_to_do(const std::set<size_t>& to_do) {
+// size of the buffers of the output and error files
+const size_t output_buffer_size {1024*1024};
+// maximum size of the output of results queued for writing
+const size_t max_queued_output {256*1024*1024};
+// time between flushes of the output and error files
+const std::chrono::milliseconds output_flush_interval {1000};
+// time between commits of the journal
+const std::chrono::milliseconds journal_commit_interval {100};
+// time between checks for expired leases
+const std::chrono::milliseconds lease_check_interval {1000};
+// number of times the backoff of a retried work item doubles at most
+const size_t max_backoff_doublings {10};
+
+/*
+  Work items are sent in chunks when a maximum chunk size larger than 1
+  is specified.  The chunk size is determined by factoring: half of the
+  work items that remain is divided into equal parts for the slots of all
+  clients, so chunks are large at the start, and shrink to a single work
+  item towards the end to avoid a long tail.  The number of slots of a
+  client is estimated by the largest number of work items it requested
+  at once.
+ */
+using Chunk_policy = struct {
+    size_t max_size;
+    size_t nr_items;
+    std::map<Uuid, size_t> nr_slots;
+};
+
+/*
+  Work items sent to a client are leased to it, the lease is renewed by
+  any message from that client, including the heartbeats it sends while
+  its work items run.  When a client is not heard from for longer than
+  the lease time, its work items are requeued, and sent to other clients
+  before any new work item.  Only the first result of a work item is
+  stored, a late result of a requeued work item is ignored.  A request
+  that can not be served while work items are still leased is parked,
+  since these may yet be requeued, it is served when that happens, or
+  answered by a stop once all work items are done.  A client that
+  reconnects gets a new address, and the replies to requests from its
+  old address are lost, so these are ignored.
+ */
+using Parked_request = struct {
+    Address address;
+    Uuid client_id;
+    size_t nr_requested;
+};
+
+/*
+  A work item that fails can be retried in the same run, rather than in a
+  run that resumes it, so that a transient failure costs seconds rather
+  than another wait in the queue.  A work item whose exit status is
+  retryable, any non-zero status unless specific ones are given, is run
+  at most a maximum number of times, its result is only stored when it
+  succeeds, or at its last attempt.  The result of a failed attempt is
+  dropped, and the work item is requeued once its backoff ends, the
+  backoff doubles with each attempt.  Optionally, a client doesn't get a
+  work item that failed on it while there is other work for it.
+ */
+using Retry_policy = struct {
+    size_t max_attempts;
+    std::set<int> exit_codes;
+    std::chrono::seconds backoff;
+    bool is_elsewhere;
+};
+
+using Lease_state = struct {
+    std::chrono::seconds lease_time;
+    // work items that were sent, but are not done, and their clients
+    std::map<size_t, Uuid> to_do;
+    std::map<Uuid, std::chrono::steady_clock::time_point> last_seen;
+    std::map<Uuid, Address> addresses;
+    std::deque<size_t> requeued;
+    std::vector<bool> is_done;
+    std::vector<Parked_request> parked;
+    // time work items that are not done were sent
+    std::map<size_t, std::chrono::steady_clock::time_point> start_times;
+    // maximum number of speculative copies of a work item, 0 for none
+    size_t max_copies;
+    // clients that run a speculative copy of a work item
+    std::map<size_t, std::set<Uuid>> copies;
+    // clients that are to cancel a work item that is done
+    std::vector<std::pair<Uuid, size_t>> to_cancel;
+    // how work items that fail are retried
+    Retry_policy retry;
+    // number of failed attempts of work items, and the clients these
+    // failed on
+    std::map<size_t, size_t> nr_failed;
+    std::map<size_t, std::set<Uuid>> failed_on;
+    // work items that are requeued when their backoff ends
+    std::multimap<std::chrono::steady_clock::time_point, size_t> delayed;
+    // number of results ignored since their work items were done already
+    size_t nr_duplicates;
+};
+
+/*
+  A run that is resumed skips the work items that were done by the
+  previous run, the work items keep their IDs.  The IDs are taken from
+  the journal of the previous run, or from its log if it has no journal,
+  and set in a bitmap.  When the previous run resumed a run in turn, its
+  journal or log records the directory of that run, which is read as
+  well.  Work items that failed are done again only when that is
+  requested.
+ */
+const std::string resume_journal_name {"journal.bin"};
+const std::string resume_log_name {"server.log"};
+const std::string resumed_msg {"]: resumed from '"};
+const std::string workitem_msg {"]: workitem "};
+const std::string done_msg {" done: "};
+const std::string started_msg {" started: "};
+
+std::string format_address(const Address& address) {
+    // 0MQ generates binary routing addresses
+    static const char digits[] {"0123456789abcdef"};
+    std::string hex;
+    for (unsigned char c: address) {
+        hex += digits[c >> 4];
+        hex += digits[c & 0xf];
+    }
+    return hex;
+}
+
+void print_to_do(const std::map<size_t, Uuid>& to_do) {
     std::cerr << "To do: ";
-    for (const auto& id: to_do)
+    for (const auto& [id, client_id]: to_do)
         std::cerr << " " << id;
     std::cerr << std::endl;
 }
@@ -48,14 +202,74 @@ using namespace logging::trivial;
 
 void write_server_info(const std::string& file_name, const Uuid& id,
         const std::string& info_str);
-size_t send_work(zmq::socket_t& socket, const Uuid& dest,
-        wp::Work_parser& parser, wm::Message_builder& msg_builder);
-void send_stop(zmq::socket_t& socket, const Uuid& dest,
-        wm::Message_builder& msg_builder);
-void send_ack(zmq::socket_t& socket, const Uuid& dest,
+bool read_completed(const boost::filesystem::path& dir, bool is_redo,
+        std::vector<bool>& completed,
+        std::set<boost::filesystem::path>& visited);
+void read_completed_journal(const boost::filesystem::path& file_name,
+        bool is_redo, std::vector<bool>& completed,
+        std::vector<boost::filesystem::path>& previous_dirs);
+void read_completed_log(std::istream& log, bool is_redo,
+        std::vector<bool>& completed,
+        std::vector<boost::filesystem::path>& previous_dirs);
+bool read_walltimes(const boost::filesystem::path& dir,
+        std::vector<double>& walltimes,
+        std::set<boost::filesystem::path>& visited);
+void read_walltimes_journal(const boost::filesystem::path& file_name,
+        std::vector<double>& walltimes,
+        std::vector<boost::filesystem::path>& previous_dirs);
+void read_walltimes_log(std::istream& log, std::vector<double>& walltimes,
+        std::vector<boost::filesystem::path>& previous_dirs);
+double log_time(const std::string& line);
+size_t read_estimates(const wp::Work_file& work_file,
+        std::vector<double>& estimates);
+size_t nr_credits(const wm::Message& msg);
+size_t chunk_size(const Chunk_policy& chunking, size_t nr_dispatched);
+bool has_work(const wp::Work_parser& parser, Lease_state& leases);
+std::pair<size_t, std::string> next_work(wp::Work_parser& parser,
+        const wp::Work_file& work_file, Lease_state& leases,
+        const Uuid& dest);
+void dispatch_work(zmq::socket_t& socket, const Address& address,
+        const Uuid& dest, size_t nr_requested, wp::Work_parser& parser,
+        const wp::Work_file& work_file, wm::Message_builder& msg_builder,
+        Chunk_policy& chunking, Lease_state& leases,
+        worker::Journal* journal);
+void serve_parked(zmq::socket_t& socket, wp::Work_parser& parser,
+        const wp::Work_file& work_file, wm::Message_builder& msg_builder,
+        Chunk_policy& chunking, Lease_state& leases,
+        worker::Journal* journal);
+size_t requeue_expired(Chunk_policy& chunking, Lease_state& leases,
+        worker::Journal* journal);
+size_t requeue_delayed(Lease_state& leases);
+size_t requeue_not_held(Lease_state& leases, const Uuid& client_id,
+        const std::set<size_t>& held, worker::Journal* journal);
+void forget_requests(Lease_state& leases, const Uuid& client_id);
+std::set<size_t> decode_work_ids(std::string_view content);
+void store_result(size_t work_id, std::string_view result_str,
+        const Uuid& client_id, worker::Output_writer& writer,
+        Lease_state& leases, worker::Journal* journal);
+bool retry_failed(size_t work_id, const wpr::Result& result,
+        const Uuid& client_id, Lease_state& leases, worker::Journal* journal);
+std::set<int> parse_exit_codes(const std::string& codes_str);
+size_t dispatch_copies(zmq::socket_t& socket, const Address& address,
+        const Uuid& dest, size_t nr_requested,
+        const wp::Work_file& work_file, wm::Message_builder& msg_builder,
+        Lease_state& leases);
+void send_cancels(zmq::socket_t& socket, wm::Message_builder& msg_builder,
+        Lease_state& leases, bool is_done);
+void send_work(zmq::socket_t& socket, const Address& address,
+        const Uuid& dest, size_t work_id, std::string work_item,
         wm::Message_builder& msg_builder);
-void send_ack_stop(zmq::socket_t& socket, const Uuid& dest,
+void send_work_chunk(zmq::socket_t& socket, const Address& address,
+        const Uuid& dest, const wm::Chunk& chunk,
         wm::Message_builder& msg_builder);
+void send_stop(zmq::socket_t& socket, const Address& address,
+        const Uuid& dest, wm::Message_builder& msg_builder);
+void send_ack(zmq::socket_t& socket, const Address& address,
+        const Uuid& dest, wm::Message_builder& msg_builder);
+void send_ack_stop(zmq::socket_t& socket, const Address& address,
+        const Uuid& dest, wm::Message_builder& msg_builder);
+void send_heartbeat(zmq::socket_t& socket, const Address& address,
+        const Uuid& dest, wm::Message_builder& msg_builder);
 
 int main(int argc, char* argv[]) {
     // determine UUID for this run
@@ -67,24 +281,105 @@ int main(int argc, char* argv[]) {
 
     // set up logging
     try {
-        init_logging(options.log_name);
+        init_logging(options.log_name, options.log_level);
         BOOST_LOG_TRIVIAL(info) << "server ID " << id;
     } catch (boost::wrapexcept<boost::filesystem::filesystem_error>& err) {
         std::cerr << "### error: can not create log file, " << err.what() << std::endl;
         worker::exit(worker::Error::file);
     }
 
-    // open workfile and create work parser
-    std::ifstream ifs(options.workfile_name);
-    if (ifs.fail()) {
-        BOOST_LOG_TRIVIAL(error) << "could not open workfile '" << options.workfile_name << "'";
+    // open workfile, it is indexed, and the index is cached, so that
+    // work items can be accessed directly
+    std::unique_ptr<wp::Work_file> work_file;
+    try {
+        work_file = std::make_unique<wp::Work_file>(options.workfile_name);
+    } catch (wp::work_file_exception& err) {
+        BOOST_LOG_TRIVIAL(error) << "could not open workfile '" << options.workfile_name
+            << "', " << err.what();
         std::cerr << "### error: can not open workfile '" << options.workfile_name << "'" << std::endl;
         worker::exit(worker::Error::file);
     }
-    wp::Work_parser parser(ifs);
+    BOOST_LOG_TRIVIAL(info) << "workfile has " << work_file->nr_items()
+        << " work items, index "
+        << (work_file->is_index_cached() ? "cached" : "built");
+    wp::Work_parser parser(*work_file);
+
+    // when a previous run is resumed, skip the work items it completed
+    std::vector<bool> completed;
+    size_t nr_completed {0};
+    if (options.resume_dir.length() > 0) {
+        std::set<boost::filesystem::path> visited;
+        if (!read_completed(options.resume_dir, options.is_redo, completed,
+                            visited)) {
+            std::cerr << "### error: can not read log of run to resume in '"
+                << options.resume_dir << "'" << std::endl;
+            worker::exit(worker::Error::file);
+        }
+        completed.resize(std::max(completed.size(), work_file->nr_items() + 1));
+        for (size_t work_id = 1; work_id <= work_file->nr_items(); ++work_id)
+            nr_completed += completed[work_id];
+        BOOST_LOG_TRIVIAL(info) << "resumed from '"
+            << boost::filesystem::absolute(options.resume_dir).string() << "'";
+        BOOST_LOG_TRIVIAL(info) << nr_completed << " work items completed before";
+        parser.skip(completed);
+    }
+
+    // dispatch the work items that are expected to take longest first
+    if (options.is_longest_first) {
+        std::vector<double> estimates(work_file->nr_items() + 1, -1.0);
+        if (options.estimates_dir.length() > 0) {
+            std::set<boost::filesystem::path> visited;
+            if (!read_walltimes(options.estimates_dir, estimates, visited)) {
+                std::cerr << "### error: can not read log of run with "
+                    << "estimates in '" << options.estimates_dir << "'"
+                    << std::endl;
+                worker::exit(worker::Error::file);
+            }
+            estimates.resize(work_file->nr_items() + 1, -1.0);
+        }
+        size_t nr_directives = read_estimates(*work_file, estimates);
+        size_t nr_estimates = std::count_if(estimates.begin() + 1,
+                estimates.end(), [] (double estimate) {
+                    return estimate >= 0.0;
+                });
+        parser.prioritize(estimates);
+        BOOST_LOG_TRIVIAL(info) << "dispatching longest first, "
+            << nr_estimates << " work items have an estimate, "
+            << nr_directives << " from directives";
+    }
 
-    // open output file
+    // the journal records the state transitions of the work items
+    std::unique_ptr<worker::Journal> journal;
+    if (options.journal_name.length() > 0) {
+        std::string resumed_dir;
+        if (options.resume_dir.length() > 0)
+            resumed_dir = boost::filesystem::absolute(options.resume_dir).string();
+        try {
+            journal = std::make_unique<worker::Journal>(options.journal_name,
+                    work_file->nr_items(), resumed_dir,
+                    journal_commit_interval);
+        } catch (std::system_error& err) {
+            BOOST_LOG_TRIVIAL(error) << "could not create journal '"
+                << options.journal_name << "', " << err.what();
+            std::cerr << "### error: can not create journal file '"
+                << options.journal_name << "'" << std::endl;
+            worker::exit(worker::Error::file);
+        }
+    }
+
+    // to determine chunk sizes, the total number of work items is required
+    Chunk_policy chunking {options.max_chunk_size,
+                           work_file->nr_items() - nr_completed, {}};
+    if (chunking.max_size > 1) {
+        BOOST_LOG_TRIVIAL(info) << "chunking " << chunking.nr_items
+            << " work items, maximum chunk size " << chunking.max_size;
+    }
+
+    // open output file, output is written by a separate thread, with
+    // large buffers
+    std::vector<char> out_buffer(output_buffer_size);
     std::ofstream ofs;
+    ofs.rdbuf()->pubsetbuf(out_buffer.data(), out_buffer.size());
     if (options.out_name.length() > 0) {
         ofs.open(options.out_name);
         if (ofs.fail()) {
@@ -96,7 +391,9 @@ int main(int argc, char* argv[]) {
     std::ostream& out_stream(ofs.is_open() ? ofs : std::cout);
 
     // open error file
-    std::ofstream efs(options.err_name);
+    std::vector<char> err_buffer(output_buffer_size);
+    std::ofstream efs;
+    efs.rdbuf()->pubsetbuf(err_buffer.data(), err_buffer.size());
     if (options.err_name.length() > 0) {
         efs.open(options.err_name);
         if (efs.fail()) {
@@ -107,17 +404,85 @@ int main(int argc, char* argv[]) {
     }
     std::ostream& err_stream(efs.is_open() ? efs : std::cerr);
 
+    // open index file, it records the location of output that clients
+    // stored themselves, by default, that goes to the output
+    std::ofstream ifs_index;
+    if (options.index_name.length() > 0) {
+        ifs_index.open(options.index_name);
+        if (ifs_index.fail()) {
+            BOOST_LOG_TRIVIAL(error) << "could not open index '" << options.index_name << "'";
+            std::cerr << "### error: can not create index file '" << options.index_name << "'" << std::endl;
+            worker::exit(worker::Error::file);
+        }
+    }
+    std::ostream& index_stream(ifs_index.is_open() ? ifs_index : out_stream);
+
+    // open usage file, it records the resources used by each work item
+    std::ofstream ufs;
+    if (options.usage_name.length() > 0) {
+        ufs.open(options.usage_name);
+        if (ufs.fail()) {
+            BOOST_LOG_TRIVIAL(error) << "could not open usage '" << options.usage_name << "'";
+            std::cerr << "### error: can not create usage file '" << options.usage_name << "'" << std::endl;
+            worker::exit(worker::Error::file);
+        }
+        ufs << "item_id\tstatus\twalltime_us\tuser_time_us\t"
+            << "system_time_us\tmax_rss_kb\tread_blocks\twrite_blocks\n";
+    }
+
+    // results are written by a separate thread so that clients don't wait
+    // for the filesystem
+    std::unique_ptr<worker::Output_writer> output_writer;
+    try {
+        output_writer = std::make_unique<worker::Output_writer>(
+                out_stream, err_stream, index_stream,
+                ufs.is_open() ? &ufs : nullptr, max_queued_output,
+                output_flush_interval, options.is_ordered,
+                options.max_reorder_size);
+    } catch (std::system_error& err) {
+        BOOST_LOG_TRIVIAL(error) << "could not create reorder file, " << err.what();
+        std::cerr << "### error: can not create reorder file" << std::endl;
+        worker::exit(worker::Error::file);
+    }
+    auto& writer = *output_writer;
+
+    // work items that were completed before are done, and are never
+    // leased
+    Lease_state leases {std::chrono::seconds(options.lease_time),
+                        {}, {}, {}, {}, completed, {}, {},
+                        options.max_copies, {}, {},
+                        {options.max_attempts,
+                         parse_exit_codes(options.retry_exit_codes),
+                         std::chrono::seconds(options.retry_backoff),
+                         options.is_retry_elsewhere},
+                        {}, {}, {}, 0};
+    leases.is_done.resize(work_file->nr_items() + 1);
+    if (leases.lease_time.count() > 0)
+        BOOST_LOG_TRIVIAL(info) << "lease time " << options.lease_time << " s";
+    if (leases.max_copies > 0)
+        BOOST_LOG_TRIVIAL(info) << "at most " << leases.max_copies
+            << " speculative copies of a work item";
+    if (leases.retry.max_attempts > 1)
+        BOOST_LOG_TRIVIAL(info) << "at most " << leases.retry.max_attempts
+            << " attempts of a failed work item, backoff "
+            << options.retry_backoff << " s";
+    if (nr_completed > 0)
+        writer.skip(std::move(completed));
+
     // create socket and bind to it
     const std::string protocol {"tcp"};
     auto hostname = boost::asio::ip::host_name();
     const std::string bind_str {protocol + "://*:" +
         std::to_string(options.port_nr)};
 
+    // a ROUTER socket is used so that the server is not forced into a
+    // lockstep request/reply cycle, replies are routed to the client
+    // that sent the request by its address
     zmq::context_t context(1);
-    zmq::socket_t socket(context, ZMQ_REP);
+    zmq::socket_t socket(context, ZMQ_ROUTER);
     try {
         socket.bind(bind_str);
-        BOOST_LOG_TRIVIAL(info) << "socket boundi on " << bind_str;
+        BOOST_LOG_TRIVIAL(info) << "socket bound on " << bind_str;
     } catch (zmq::error_t& err) {
         BOOST_LOG_TRIVIAL(error) << "socket binding failed, " << err.what();
         std::cerr << "### error: socket can not bind to " << bind_str << std::endl;
@@ -131,66 +496,203 @@ int main(int argc, char* argv[]) {
     write_server_info(options.server_info, id, info_str);
 
     wm::Message_builder msg_builder(id);
-    // set of open work item IDs, i.e., work items started, but not completed yet
-    std::set<size_t> to_do;
-
+    auto last_lease_check = std::chrono::steady_clock::now();
 
     // start message loop
     for (;;) {
-        // wait for incoming messages
-        zmq::message_t request;
-        auto recv_result = socket.recv(request, zmq::recv_flags::none);
+        // requeue the work items of clients whose leases expired, and send
+        // them in reply to parked requests
+        if (leases.lease_time.count() > 0 &&
+                std::chrono::steady_clock::now() - last_lease_check >=
+                lease_check_interval) {
+            last_lease_check = std::chrono::steady_clock::now();
+            if (requeue_expired(chunking, leases, journal.get()) > 0)
+                serve_parked(socket, parser, *work_file, msg_builder,
+                             chunking, leases, journal.get());
+        }
+
+        // requeue the failed work items whose backoff ended
+        if (!leases.delayed.empty() && requeue_delayed(leases) > 0)
+            serve_parked(socket, parser, *work_file, msg_builder,
+                         chunking, leases, journal.get());
+
+        // wait for incoming messages, but not beyond the next lease check
+        zmq::pollitem_t items[] = {{socket.handle(), 0, ZMQ_POLLIN, 0}};
+        zmq::poll(items, 1, lease_check_interval);
+        if (!(items[0].revents & ZMQ_POLLIN))
+            continue;
+        // a message that can not be parsed, e.g., from a client of
+        // another version, is dropped rather than ending the job
+        Address address;
+        std::optional<wm::Message> recv_result;
+        try {
+            recv_result = recv_message(socket, address, msg_builder);
+        } catch (wm::message_parse_exception& err) {
+            BOOST_LOG_TRIVIAL(warning) << "malformed message from "
+                << format_address(address) << " dropped, " << err.what();
+            continue;
+        }
         if (!recv_result) {
             BOOST_LOG_TRIVIAL(error) << "server could not receive message";
+            continue;
         }
-        auto msg = unpack_message(request, msg_builder);
+        auto msg = std::move(*recv_result);
+        // any message of a client renews the leases of its work items, a
+        // client whose leases expired can get work for its parked requests
+        auto [client, is_new] = leases.last_seen.insert_or_assign(
+                msg.from(), std::chrono::steady_clock::now());
+        if (is_new && !leases.parked.empty())
+            serve_parked(socket, parser, *work_file, msg_builder,
+                         chunking, leases, journal.get());
+        // a client's address is that of its first message, or of the
+        // heartbeat listing its work items when it reconnected
+        auto& client_address = leases.addresses.try_emplace(
+                msg.from(), address).first->second;
+        if (msg.subject() == wm::Subject::heartbeat && msg.length() > 0)
+            client_address = address;
+        bool is_stale {client_address != address};
 
         // handle incoming message
         if (msg.subject() == wm::Subject::query) {
-            // client wants work, if there is work, send it, if not send stop message
-            BOOST_LOG_TRIVIAL(info) << "query message from "
-                << msg.from();
-            if (parser.has_next()) {
-                size_t work_id = send_work(socket, msg.from(), parser, msg_builder);
-                to_do.insert(work_id);
-                BOOST_LOG_TRIVIAL(info) << "workitem " << work_id
-                    << " started: " << msg.from();
+            // client wants work, send as many work items as it asks for
+            size_t nr_requested = nr_credits(msg);
+            BOOST_LOG_TRIVIAL(debug) << "query message from "
+                << msg.from() << " for " << nr_requested << " items";
+            auto& nr_slots = chunking.nr_slots[msg.from()];
+            nr_slots = std::max(nr_slots, nr_requested);
+            if (!is_stale)
+                dispatch_work(socket, address, msg.from(), nr_requested,
+                        parser, *work_file, msg_builder, chunking, leases,
+                        journal.get());
+        } else if (msg.subject() == wm::Subject::result_query) {
+            // client sent result and wants new work, the reply, either
+            // work or stop, acknowledges the result
+            BOOST_LOG_TRIVIAL(debug) << "result_query message for " << msg.id()
+                << " from " << msg.from();
+            store_result(msg.id(), msg.content(), msg.from(), writer, leases,
+                         journal.get());
+            if (!is_stale)
+                dispatch_work(socket, address, msg.from(), 1,
+                        parser, *work_file, msg_builder, chunking, leases,
+                        journal.get());
+        } else if (msg.subject() == wm::Subject::result ||
+                   msg.subject() == wm::Subject::result_chunk) {
+            // client sent result(s), handle it, and send acknowledgement
+            if (msg.subject() == wm::Subject::result) {
+                BOOST_LOG_TRIVIAL(debug) << "result message for " << msg.id()
+                    << " from " << msg.from();
+                store_result(msg.id(), msg.content(), msg.from(), writer,
+                             leases, journal.get());
             } else {
-                send_stop(socket, msg.from(), msg_builder);
-                BOOST_LOG_TRIVIAL(info) << "stop message to "
-                    << msg.from();
+                wm::Chunk_view results;
+                try {
+                    results = wm::decode_chunk(msg.content());
+                } catch (wm::message_parse_exception& err) {
+                    // it is still acknowledged, since the client counts
+                    // replies, and the results it lost can not be told
+                    // apart, so all work items leased to the client are
+                    // requeued, results that arrive later are stored
+                    BOOST_LOG_TRIVIAL(warning) << "malformed result_chunk "
+                        << "from " << msg.from() << " dropped, " << err.what();
+                    if (requeue_not_held(leases, msg.from(), {},
+                                         journal.get()) > 0)
+                        serve_parked(socket, parser, *work_file, msg_builder,
+                                     chunking, leases, journal.get());
+                }
+                BOOST_LOG_TRIVIAL(debug) << "result_chunk message for "
+                    << results.size() << " items from " << msg.from();
+                for (const auto& [work_id, result_str]: results)
+                    store_result(work_id, result_str, msg.from(), writer,
+                                 leases, journal.get());
             }
-        } else if (msg.subject() == wm::Subject::result) {
-            // client sent result, handle it, and send acknowledgement
-            BOOST_LOG_TRIVIAL(info) << "result message for " << msg.id()
-                << " from " << msg.from();
-            std::string result_str = msg.content();
-            wpr::Result result(result_str);
-            out_stream << result.stdout() << std::endl;
-            err_stream << result.stderr() << std::endl;
-            BOOST_LOG_TRIVIAL(info) << "workitem " << msg.id()
-                << " done: " << result.exit_status();
-            to_do.erase(msg.id());
-            if (parser.has_next()) {
-                send_ack(socket, msg.from(), msg_builder);
-                BOOST_LOG_TRIVIAL(info) << "ack message to "
+            // work items that are leased may still be requeued
+            if (has_work(parser, leases) || !leases.to_do.empty() ||
+                    !leases.delayed.empty()) {
+                send_ack(socket, address, msg.from(), msg_builder);
+                BOOST_LOG_TRIVIAL(debug) << "ack message to "
                     << msg.from();
             } else {
-                send_ack_stop(socket, msg.from(), msg_builder);
-                BOOST_LOG_TRIVIAL(info) << "ack_stop message to "
+                send_ack_stop(socket, address, msg.from(), msg_builder);
+                BOOST_LOG_TRIVIAL(debug) << "ack_stop message to "
                     << msg.from();
             }
+        } else if (msg.subject() == wm::Subject::heartbeat) {
+            BOOST_LOG_TRIVIAL(debug) << "heartbeat message from "
+                << msg.from();
+            send_heartbeat(socket, address, msg.from(), msg_builder);
+            if (msg.length() > 0) {
+                // a client that reconnected lists the work items it holds,
+                // those sent in replies it lost are requeued, and its
+                // requests are forgotten, it sends them again
+                std::set<size_t> held;
+                try {
+                    held = decode_work_ids(msg.content());
+                } catch (wm::message_parse_exception& err) {
+                    BOOST_LOG_TRIVIAL(warning) << "malformed heartbeat from "
+                        << msg.from() << " dropped, " << err.what();
+                    continue;
+                }
+                BOOST_LOG_TRIVIAL(warning) << "client " << msg.from()
+                    << " reconnected, holds " << held.size() << " items";
+                forget_requests(leases, msg.from());
+                if (requeue_not_held(leases, msg.from(), held,
+                                     journal.get()) > 0)
+                    serve_parked(socket, parser, *work_file, msg_builder,
+                                 chunking, leases, journal.get());
+            }
+        } else if (msg.subject() == wm::Subject::leave) {
+            // a client that leaves lists the work items it still finishes,
+            // the others leased to it are requeued, and it no longer
+            // counts for the chunk sizes
+            std::set<size_t> kept;
+            try {
+                kept = decode_work_ids(msg.content());
+            } catch (wm::message_parse_exception& err) {
+                // it is still acknowledged, since the client counts
+                // replies, its work items are requeued when its lease
+                // expires after it exited
+                BOOST_LOG_TRIVIAL(warning) << "malformed leave message from "
+                    << msg.from() << " dropped, " << err.what();
+                send_ack(socket, address, msg.from(), msg_builder);
+                continue;
+            }
+            BOOST_LOG_TRIVIAL(info) << "client " << msg.from()
+                << " leaves, finishes " << kept.size() << " items";
+            send_ack(socket, address, msg.from(), msg_builder);
+            forget_requests(leases, msg.from());
+            chunking.nr_slots.erase(msg.from());
+            if (requeue_not_held(leases, msg.from(), kept,
+                                 journal.get()) > 0)
+                serve_parked(socket, parser, *work_file, msg_builder,
+                             chunking, leases, journal.get());
         } else {
-            BOOST_LOG_TRIVIAL(fatal) << "invalid message";
-            worker::exit(worker::Error::unexpected);
+            BOOST_LOG_TRIVIAL(warning) << "message with invalid subject from "
+                << msg.from() << " dropped";
         }
-        if (!parser.has_next() && to_do.empty()) {
+        bool is_done {!has_work(parser, leases) && leases.to_do.empty() &&
+                      leases.delayed.empty()};
+        if (!leases.to_cancel.empty())
+            send_cancels(socket, msg_builder, leases, is_done);
+        if (is_done) {
+            // parked requests are answered by a stop
+            serve_parked(socket, parser, *work_file, msg_builder,
+                         chunking, leases, journal.get());
             BOOST_LOG_TRIVIAL(info) << "processing done";
+            if (leases.nr_duplicates > 0)
+                BOOST_LOG_TRIVIAL(info) << leases.nr_duplicates
+                    << " duplicate results ignored";
+            if (journal)
+                journal->end();
             break;
         }
     }
     std::this_thread::sleep_for(std::chrono::seconds(options.wait_time));
+    // the writer and the journal log as they finish, so they are done
+    // before logging stops
+    output_writer.reset();
+    journal.reset();
     BOOST_LOG_TRIVIAL(info) << "exiting normally";
+    stop_logging();
     return 0;
 }
 
@@ -200,8 +702,18 @@ Options get_options(int argc, char* argv[]) {
     const int default_port {5555};
     std::string default_out_name {""};
     std::string default_err_name {""};
+    std::string default_index_name {""};
     std::string default_log_name {"server.log"};
     long default_wait_time {3};
+    size_t default_max_chunk_size {1};
+    size_t default_max_reorder_size {64*1024*1024};
+    std::string default_resume_dir {""};
+    std::string default_journal_name {""};
+    std::string default_usage_name {""};
+    long default_lease_time {30};
+    // clients don't know the lease time, a lease should outlast two of
+    // their default heartbeat intervals of 10 s
+    long min_lease_time {20};
 
     po::options_description desc("Allowed options");
     desc.add_options()
@@ -217,12 +729,68 @@ Options get_options(int argc, char* argv[]) {
          ->default_value(default_out_name), "output file name")
         ("err", po::value<std::string>(&options.err_name)
          ->default_value(default_err_name), "error file name")
+        ("index", po::value<std::string>(&options.index_name)
+         ->default_value(default_index_name),
+         "file name for the location of output stored by clients")
         ("log", po::value<std::string>(&options.log_name)
          ->default_value(default_log_name),
          "log file name")
+        ("log_level", po::value<boost::log::trivial::severity_level>(&options.log_level)
+         ->default_value(boost::log::trivial::info),
+         "least severe log records to write, i.e., trace, debug, info, "
+         "warning, error or fatal")
         ("wait", po::value<long>(&options.wait_time)
          ->default_value(default_wait_time),
          "wait time before server exit in seconds")
+        ("max_chunk_size", po::value<size_t>(&options.max_chunk_size)
+         ->default_value(default_max_chunk_size),
+         "maximum number of work items sent in a single message")
+        ("ordered", po::bool_switch(&options.is_ordered),
+         "write output in the order of the work items")
+        ("reorder_size", po::value<size_t>(&options.max_reorder_size)
+         ->default_value(default_max_reorder_size),
+         "bytes of output kept in memory to write it in order")
+        ("resume", po::value<std::string>(&options.resume_dir)
+         ->default_value(default_resume_dir),
+         "directory of a previous run, its completed work items are skipped")
+        ("redo", po::bool_switch(&options.is_redo),
+         "when resuming, redo work items that failed")
+        ("longest_first", po::bool_switch(&options.is_longest_first),
+         "dispatch the work items with the longest expected walltime first")
+        ("estimates", po::value<std::string>(&options.estimates_dir),
+         "directory of a previous run of the work file, the walltimes of "
+         "its work items are the expected walltimes, implies "
+         "--longest_first")
+        ("journal", po::value<std::string>(&options.journal_name)
+         ->default_value(default_journal_name),
+         "file name for the journal of the work items' progress")
+        ("usage", po::value<std::string>(&options.usage_name)
+         ->default_value(default_usage_name),
+         "file name for the resources used by each work item")
+        ("lease_time", po::value<long>(&options.lease_time)
+         ->default_value(default_lease_time),
+         "time in seconds after which the work items of a client that "
+         "is not heard from are sent to other clients, at least "
+         "20, 0 to never requeue work items")
+        ("speculative_copies", po::value<size_t>(&options.max_copies)
+         ->default_value(0),
+         "maximum number of copies of a work item that are sent to idle "
+         "clients once all work items were sent, the first result is "
+         "kept, 0 to disable")
+        ("max_attempts", po::value<size_t>(&options.max_attempts)
+         ->default_value(1),
+         "maximum number of times a work item that fails is run, 1 to "
+         "never retry")
+        ("retry_exit_codes", po::value<std::string>(&options.retry_exit_codes)
+         ->default_value(""),
+         "comma separated exit statuses of work items that are retried, "
+         "any non-zero exit status by default")
+        ("retry_backoff", po::value<long>(&options.retry_backoff)
+         ->default_value(10),
+         "time in seconds before a failed work item is retried, doubles "
+         "with each attempt")
+        ("retry_elsewhere", po::bool_switch(&options.is_retry_elsewhere),
+         "retry a failed work item on another client, if possible")
         ;
     po::positional_options_description pos_desc;
     pos_desc.add("workfile", -1);
@@ -263,6 +831,32 @@ Options get_options(int argc, char* argv[]) {
         worker::exit(worker::Error::cli_option);
     }
 
+    if (options.lease_time < 0) {
+        std::cerr << "### error: invalid lease time" << std::endl;
+        worker::exit(worker::Error::cli_option);
+    }
+    if (options.lease_time > 0 && options.lease_time < min_lease_time) {
+        std::cerr << "### error: lease time should be at least "
+                  << min_lease_time << " s" << std::endl;
+        worker::exit(worker::Error::cli_option);
+    }
+
+    if (options.max_attempts < 1 || options.retry_backoff < 0) {
+        std::cerr << "### error: invalid retry policy" << std::endl;
+        worker::exit(worker::Error::cli_option);
+    }
+
+    try {
+        parse_exit_codes(options.retry_exit_codes);
+    } catch (std::invalid_argument&) {
+        std::cerr << "### error: invalid exit statuses to retry '"
+            << options.retry_exit_codes << "'" << std::endl;
+        worker::exit(worker::Error::cli_option);
+    }
+
+    if (options.estimates_dir.length() > 0)
+        options.is_longest_first = true;
+
     return options;
 }
 
@@ -278,48 +872,757 @@ void write_server_info(const std::string& file_name, const Uuid& id,
     BOOST_LOG_TRIVIAL(info) << "created server_info file '" << file_name << "'";
 }
 
-size_t send_work(zmq::socket_t& socket, const Uuid& dest,
-        wp::Work_parser& parser, wm::Message_builder& msg_builder) {
+bool read_completed(const boost::filesystem::path& dir, bool is_redo,
+        std::vector<bool>& completed,
+        std::set<boost::filesystem::path>& visited) {
+    boost::system::error_code err;
+    auto canonical_dir = boost::filesystem::canonical(dir, err);
+    if (err)
+        return false;
+    if (!visited.insert(canonical_dir).second)
+        return true;
+    std::vector<boost::filesystem::path> previous_dirs;
+    auto journal_name = canonical_dir / resume_journal_name;
+    if (boost::filesystem::exists(journal_name)) {
+        try {
+            read_completed_journal(journal_name, is_redo, completed,
+                                   previous_dirs);
+        } catch (worker::journal_exception& err) {
+            BOOST_LOG_TRIVIAL(error) << "could not read journal '"
+                << journal_name.string() << "', " << err.what();
+            return false;
+        }
+        BOOST_LOG_TRIVIAL(info) << "read completed work items from '"
+            << journal_name.string() << "'";
+    } else {
+        auto log_name = canonical_dir / resume_log_name;
+        std::vector<char> buffer(output_buffer_size);
+        std::ifstream log;
+        log.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+        log.open(log_name.string());
+        if (!log)
+            return false;
+        read_completed_log(log, is_redo, completed, previous_dirs);
+        BOOST_LOG_TRIVIAL(info) << "read completed work items from '"
+            << log_name.string() << "'";
+    }
+    for (const auto& previous_dir: previous_dirs) {
+        if (!read_completed(previous_dir, is_redo, completed, visited)) {
+            BOOST_LOG_TRIVIAL(warning) << "can not read state of run in '"
+                << previous_dir.string() << "', its work items are done again";
+            std::cerr << "### warning: can not read state of run in '"
+                << previous_dir.string() << "'" << std::endl;
+        }
+    }
+    return true;
+}
+
+void read_completed_journal(const boost::filesystem::path& file_name,
+        bool is_redo, std::vector<bool>& completed,
+        std::vector<boost::filesystem::path>& previous_dirs) {
+    worker::Journal_reader reader(file_name.string());
+    if (!reader.resumed_dir().empty())
+        previous_dirs.emplace_back(reader.resumed_dir());
+    completed.resize(std::max(completed.size(), reader.nr_items() + 1));
+    const size_t batch_size {64*1024};
+    std::vector<worker::Journal_record> records;
+    while (reader.read(records, batch_size) > 0) {
+        for (const auto& record: records) {
+            if (record.event != worker::Journal_event::done ||
+                    (is_redo && record.exit_status != 0))
+                continue;
+            if (record.work_id >= completed.size())
+                completed.resize(record.work_id + 1);
+            completed[record.work_id] = true;
+        }
+    }
+}
+
+void read_completed_log(std::istream& log, bool is_redo,
+        std::vector<bool>& completed,
+        std::vector<boost::filesystem::path>& previous_dirs) {
+    std::string line;
+    while (std::getline(log, line)) {
+        auto pos = line.find(workitem_msg);
+        if (pos != std::string::npos) {
+            const char* first = line.data() + pos + workitem_msg.length();
+            const char* last = line.data() + line.length();
+            size_t work_id;
+            auto [id_end, id_err] = std::from_chars(first, last, work_id);
+            if (id_err != std::errc() ||
+                    line.compare(id_end - line.data(), done_msg.length(),
+                                 done_msg) != 0)
+                continue;
+            int exit_status;
+            auto [status_end, status_err] = std::from_chars(
+                    id_end + done_msg.length(), last, exit_status);
+            if (status_err != std::errc() || (is_redo && exit_status != 0))
+                continue;
+            if (work_id >= completed.size())
+                completed.resize(std::max(work_id + 1, 2*completed.size()));
+            completed[work_id] = true;
+        } else if ((pos = line.find(resumed_msg)) != std::string::npos) {
+            auto first = pos + resumed_msg.length();
+            auto last = line.rfind('\'');
+            if (last > first)
+                previous_dirs.emplace_back(line.substr(first, last - first));
+        }
+    }
+}
+
+/*
+  Work items can be dispatched in order of decreasing expected walltime
+  rather than in the order of the work file, so that a long work item
+  near the end of the work file doesn't keep a single client busy while
+  all others are idle.  The expected walltime of a work item is given by
+  its estimate directive, or else by its walltime in a previous run of
+  the same work file, read from its journal or log, the most recent run
+  first.  Work items without either take the mean of the known ones.
+ */
+bool read_walltimes(const boost::filesystem::path& dir,
+        std::vector<double>& walltimes,
+        std::set<boost::filesystem::path>& visited) {
+    boost::system::error_code err;
+    auto canonical_dir = boost::filesystem::canonical(dir, err);
+    if (err)
+        return false;
+    if (!visited.insert(canonical_dir).second)
+        return true;
+    std::vector<boost::filesystem::path> previous_dirs;
+    auto journal_name = canonical_dir / resume_journal_name;
+    if (boost::filesystem::exists(journal_name)) {
+        try {
+            read_walltimes_journal(journal_name, walltimes, previous_dirs);
+        } catch (worker::journal_exception& err) {
+            BOOST_LOG_TRIVIAL(error) << "could not read journal '"
+                << journal_name.string() << "', " << err.what();
+            return false;
+        }
+        BOOST_LOG_TRIVIAL(info) << "read walltimes of work items from '"
+            << journal_name.string() << "'";
+    } else {
+        auto log_name = canonical_dir / resume_log_name;
+        std::vector<char> buffer(output_buffer_size);
+        std::ifstream log;
+        log.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+        log.open(log_name.string());
+        if (!log)
+            return false;
+        read_walltimes_log(log, walltimes, previous_dirs);
+        BOOST_LOG_TRIVIAL(info) << "read walltimes of work items from '"
+            << log_name.string() << "'";
+    }
+    // work items that were done in the most recent run are skipped in the
+    // runs it resumed
+    for (const auto& previous_dir: previous_dirs) {
+        if (!read_walltimes(previous_dir, walltimes, visited))
+            BOOST_LOG_TRIVIAL(warning) << "can not read walltimes of run in '"
+                << previous_dir.string() << "'";
+    }
+    return true;
+}
+
+void read_walltimes_journal(const boost::filesystem::path& file_name,
+        std::vector<double>& walltimes,
+        std::vector<boost::filesystem::path>& previous_dirs) {
+    worker::Journal_reader reader(file_name.string());
+    if (!reader.resumed_dir().empty())
+        previous_dirs.emplace_back(reader.resumed_dir());
+    walltimes.resize(std::max(walltimes.size(), reader.nr_items() + 1), -1.0);
+    // a work item that was started more than once is timed from its last
+    // start to its first result
+    std::vector<std::int64_t> start_times(walltimes.size());
+    std::vector<bool> is_timed(walltimes.size());
+    const size_t batch_size {64*1024};
+    std::vector<worker::Journal_record> records;
+    while (reader.read(records, batch_size) > 0) {
+        for (const auto& record: records) {
+            if (record.event != worker::Journal_event::started &&
+                    record.event != worker::Journal_event::done)
+                continue;
+            if (record.work_id >= walltimes.size()) {
+                walltimes.resize(record.work_id + 1, -1.0);
+                start_times.resize(record.work_id + 1);
+                is_timed.resize(record.work_id + 1);
+            }
+            if (record.event == worker::Journal_event::started) {
+                start_times[record.work_id] = record.time;
+            } else if (!is_timed[record.work_id] &&
+                       start_times[record.work_id] != 0) {
+                is_timed[record.work_id] = true;
+                if (walltimes[record.work_id] < 0.0)
+                    walltimes[record.work_id] =
+                        (record.time - start_times[record.work_id])/1.0e6;
+            }
+        }
+    }
+}
+
+void read_walltimes_log(std::istream& log, std::vector<double>& walltimes,
+        std::vector<boost::filesystem::path>& previous_dirs) {
+    std::vector<double> start_times(walltimes.size());
+    std::vector<bool> is_timed(walltimes.size());
+    std::string line;
+    while (std::getline(log, line)) {
+        auto pos = line.find(workitem_msg);
+        if (pos != std::string::npos) {
+            const char* first = line.data() + pos + workitem_msg.length();
+            const char* last = line.data() + line.length();
+            size_t work_id;
+            auto [id_end, id_err] = std::from_chars(first, last, work_id);
+            if (id_err != std::errc())
+                continue;
+            size_t offset = id_end - line.data();
+            bool is_started = line.compare(offset, started_msg.length(),
+                                           started_msg) == 0;
+            bool is_done = line.compare(offset, done_msg.length(),
+                                        done_msg) == 0;
+            if (!is_started && !is_done)
+                continue;
+            if (work_id >= walltimes.size()) {
+                size_t size = std::max(work_id + 1, 2*walltimes.size());
+                walltimes.resize(size, -1.0);
+                start_times.resize(size);
+                is_timed.resize(size);
+            }
+            double time = log_time(line);
+            if (is_started) {
+                start_times[work_id] = time;
+            } else if (!is_timed[work_id] && start_times[work_id] > 0.0 &&
+                       time > 0.0) {
+                is_timed[work_id] = true;
+                if (walltimes[work_id] < 0.0)
+                    walltimes[work_id] = time - start_times[work_id];
+            }
+        } else if ((pos = line.find(resumed_msg)) != std::string::npos) {
+            auto first = pos + resumed_msg.length();
+            auto last = line.rfind('\'');
+            if (last > first)
+                previous_dirs.emplace_back(line.substr(first, last - first));
+        }
+    }
+}
+
+double log_time(const std::string& line) {
+    // log records start with the time, e.g., 2024-01-31 12:34:56.789012
+    std::tm tm {};
+    double seconds;
+    if (std::sscanf(line.c_str(), "%d-%d-%d %d:%d:%lf", &tm.tm_year,
+                    &tm.tm_mon, &tm.tm_mday, &tm.tm_hour, &tm.tm_min,
+                    &seconds) != 6)
+        return 0.0;
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    return static_cast<double>(timegm(&tm)) + seconds;
+}
+
+size_t read_estimates(const wp::Work_file& work_file,
+        std::vector<double>& estimates) {
+    size_t nr_estimates {0};
+    for (size_t work_id = 1; work_id <= work_file.nr_items(); ++work_id) {
+        try {
+            auto directives = wpr::parse_directives(work_file.item(work_id));
+            if (directives.estimate.count() >= 0) {
+                estimates[work_id] = directives.estimate.count();
+                ++nr_estimates;
+            }
+        } catch (wpr::directive_parse_exception& err) {
+            BOOST_LOG_TRIVIAL(warning) << "workitem " << work_id
+                << " has a malformed directive, " << err.what();
+        }
+    }
+    return nr_estimates;
+}
+
+size_t nr_credits(const wm::Message& msg) {
+    // a query without content asks for a single work item
+    if (msg.length() == 0)
+        return 1;
+    try {
+        return std::max<size_t>(1, std::stoul(msg.content()));
+    } catch (std::exception&) {
+        BOOST_LOG_TRIVIAL(warning) << "invalid number of credits from "
+            << msg.from();
+        return 1;
+    }
+}
+
+size_t chunk_size(const Chunk_policy& chunking, size_t nr_dispatched) {
+    if (chunking.max_size <= 1 || nr_dispatched >= chunking.nr_items)
+        return 1;
+    size_t nr_slots {0};
+    for (const auto& [client_id, client_slots]: chunking.nr_slots)
+        nr_slots += client_slots;
+    nr_slots = std::max<size_t>(nr_slots, 1);
+    size_t nr_remaining = chunking.nr_items - nr_dispatched;
+    size_t size = (nr_remaining + 2*nr_slots - 1)/(2*nr_slots);
+    return std::clamp<size_t>(size, 1, chunking.max_size);
+}
+
+bool has_work(const wp::Work_parser& parser, Lease_state& leases) {
+    // requeued work items whose late result arrived in the meantime are
+    // dropped
+    while (!leases.requeued.empty() &&
+           leases.is_done[leases.requeued.front()])
+        leases.requeued.pop_front();
+    return !leases.requeued.empty() || parser.has_next();
+}
+
+std::pair<size_t, std::string> next_work(wp::Work_parser& parser,
+        const wp::Work_file& work_file, Lease_state& leases,
+        const Uuid& dest) {
+    auto item = leases.requeued.begin();
+    // a work item is not retried on a client it failed on, unless that
+    // client has no other work
+    if (leases.retry.is_elsewhere && !leases.failed_on.empty()) {
+        item = std::find_if(leases.requeued.begin(), leases.requeued.end(),
+                [&leases, &dest] (size_t work_id) {
+                    auto failed = leases.failed_on.find(work_id);
+                    return !leases.is_done[work_id] &&
+                        (failed == leases.failed_on.end() ||
+                         failed->second.count(dest) == 0);
+                });
+        if (item == leases.requeued.end() && !parser.has_next())
+            item = leases.requeued.begin();
+    }
+    if (item != leases.requeued.end()) {
+        size_t work_id = *item;
+        leases.requeued.erase(item);
+        return {work_id, std::string(work_file.item(work_id))};
+    }
     std::string work_item = parser.next();
-    size_t work_id = parser.nr_items();
+    return {parser.nr_items(), std::move(work_item)};
+}
+
+void dispatch_work(zmq::socket_t& socket, const Address& address,
+        const Uuid& dest, size_t nr_requested, wp::Work_parser& parser,
+        const wp::Work_file& work_file, wm::Message_builder& msg_builder,
+        Chunk_policy& chunking, Lease_state& leases,
+        worker::Journal* journal) {
+    // send the work items or chunks requested, requeued work items first,
+    // if there is not enough work left, park the remainder of the request
+    // while work items are leased, or send a stop message
+    size_t nr_sent {0};
+    for (; nr_sent < nr_requested && has_work(parser, leases); ++nr_sent) {
+        size_t size = chunk_size(chunking,
+                parser.nr_provided());
+        wm::Chunk chunk;
+        while (chunk.size() < size && has_work(parser, leases))
+            chunk.push_back(next_work(parser, work_file, leases, dest));
+        auto now = std::chrono::steady_clock::now();
+        for (const auto& [work_id, work_item]: chunk) {
+            leases.to_do[work_id] = dest;
+            leases.start_times[work_id] = now;
+            BOOST_LOG_TRIVIAL(info) << "workitem " << work_id
+                << " started: " << dest;
+            if (journal)
+                journal->started(work_id, dest);
+        }
+        if (chunk.size() == 1)
+            send_work(socket, address, dest, chunk.front().first,
+                      std::move(chunk.front().second), msg_builder);
+        else
+            send_work_chunk(socket, address, dest, chunk, msg_builder);
+    }
+    if (nr_sent < nr_requested && leases.max_copies > 0)
+        nr_sent += dispatch_copies(socket, address, dest,
+                nr_requested - nr_sent, work_file, msg_builder, leases);
+    if (nr_sent < nr_requested) {
+        if (leases.to_do.empty() && leases.delayed.empty()) {
+            send_stop(socket, address, dest, msg_builder);
+        } else {
+            BOOST_LOG_TRIVIAL(debug) << "parked request for "
+                << nr_requested - nr_sent << " items from " << dest;
+            leases.parked.push_back({address, dest, nr_requested - nr_sent});
+        }
+    }
+}
+
+void serve_parked(zmq::socket_t& socket, wp::Work_parser& parser,
+        const wp::Work_file& work_file, wm::Message_builder& msg_builder,
+        Chunk_policy& chunking, Lease_state& leases,
+        worker::Journal* journal) {
+    // requests that still can not be served are parked again, as are
+    // those of clients whose leases expired, they only get work once they
+    // are heard from again, but a stop in the end, in case they are not
+    // lost after all
+    std::vector<Parked_request> parked;
+    parked.swap(leases.parked);
+    for (const auto& request: parked) {
+        if (leases.last_seen.count(request.client_id) == 0 &&
+                has_work(parser, leases)) {
+            leases.parked.push_back(request);
+            continue;
+        }
+        dispatch_work(socket, request.address, request.client_id,
+                request.nr_requested, parser, work_file, msg_builder,
+                chunking, leases, journal);
+    }
+}
+
+size_t requeue_expired(Chunk_policy& chunking, Lease_state& leases,
+        worker::Journal* journal) {
+    auto now = std::chrono::steady_clock::now();
+    size_t nr_requeued {0};
+    for (auto client = leases.last_seen.begin();
+            client != leases.last_seen.end(); ) {
+        if (now - client->second <= leases.lease_time) {
+            ++client;
+            continue;
+        }
+        // clients that exited hold no work items
+        size_t nr_client_requeued = requeue_not_held(leases, client->first,
+                                                     {}, journal);
+        if (nr_client_requeued > 0)
+            BOOST_LOG_TRIVIAL(warning) << "lease of " << client->first
+                << " expired, " << nr_client_requeued << " items requeued";
+        nr_requeued += nr_client_requeued;
+        // a client that exited no longer counts for the chunk sizes, one
+        // that was only slow is added again by its next message
+        chunking.nr_slots.erase(client->first);
+        leases.addresses.erase(client->first);
+        client = leases.last_seen.erase(client);
+    }
+    return nr_requeued;
+}
+
+size_t requeue_delayed(Lease_state& leases) {
+    auto now = std::chrono::steady_clock::now();
+    size_t nr_requeued {0};
+    auto item = leases.delayed.begin();
+    for (; item != leases.delayed.end() && item->first <= now; ++item) {
+        leases.requeued.push_back(item->second);
+        ++nr_requeued;
+    }
+    leases.delayed.erase(leases.delayed.begin(), item);
+    return nr_requeued;
+}
+
+size_t requeue_not_held(Lease_state& leases, const Uuid& client_id,
+        const std::set<size_t>& held, worker::Journal* journal) {
+    // copies the client no longer runs are forgotten
+    for (auto copy = leases.copies.begin(); copy != leases.copies.end(); ) {
+        if (held.count(copy->first) == 0)
+            copy->second.erase(client_id);
+        if (copy->second.empty())
+            copy = leases.copies.erase(copy);
+        else
+            ++copy;
+    }
+    size_t nr_requeued {0};
+    for (auto item = leases.to_do.begin(); item != leases.to_do.end(); ) {
+        if (item->second != client_id || held.count(item->first) > 0) {
+            ++item;
+            continue;
+        }
+        // a client that runs a copy takes over the work item
+        auto copy = leases.copies.find(item->first);
+        if (copy != leases.copies.end()) {
+            item->second = *copy->second.begin();
+            copy->second.erase(copy->second.begin());
+            if (copy->second.empty())
+                leases.copies.erase(copy);
+            BOOST_LOG_TRIVIAL(info) << "workitem " << item->first
+                << " taken over by " << item->second;
+            ++item;
+            continue;
+        }
+        BOOST_LOG_TRIVIAL(warning) << "workitem " << item->first
+            << " requeued";
+        if (journal)
+            journal->requeued(item->first);
+        leases.requeued.push_back(item->first);
+        leases.start_times.erase(item->first);
+        item = leases.to_do.erase(item);
+        ++nr_requeued;
+    }
+    return nr_requeued;
+}
+
+void forget_requests(Lease_state& leases, const Uuid& client_id) {
+    leases.parked.erase(std::remove_if(leases.parked.begin(),
+                leases.parked.end(),
+                [&client_id] (const Parked_request& request) {
+                    return request.client_id == client_id;
+                }), leases.parked.end());
+}
+
+std::set<size_t> decode_work_ids(std::string_view content) {
+    std::set<size_t> work_ids;
+    for (const auto& [work_id, work_item]: wm::decode_chunk(content))
+        work_ids.insert(work_id);
+    return work_ids;
+}
+
+void store_result(size_t work_id, std::string_view result_str,
+        const Uuid& client_id, worker::Output_writer& writer,
+        Lease_state& leases, worker::Journal* journal) {
+    if (work_id == 0 || work_id >= leases.is_done.size()) {
+        BOOST_LOG_TRIVIAL(warning) << "result of unknown workitem "
+            << work_id << " ignored";
+        return;
+    }
+    // a requeued work item can be done twice, as can one that has
+    // copies, its first result is kept, the others are only counted
+    if (leases.is_done[work_id]) {
+        BOOST_LOG_TRIVIAL(debug) << "duplicate result of workitem "
+            << work_id << " ignored";
+        ++leases.nr_duplicates;
+        return;
+    }
+    // a result that can not be decoded is dropped, and the work item is
+    // requeued, so that the job doesn't wait for it
+    std::optional<wpr::Result> decoded;
+    try {
+        decoded = wpr::Result::decode(result_str);
+    } catch (wpr::result_parse_exception& err) {
+        BOOST_LOG_TRIVIAL(warning) << "malformed result of workitem "
+            << work_id << " from " << client_id << " dropped, " << err.what();
+        auto owner = leases.to_do.find(work_id);
+        if (owner != leases.to_do.end() && owner->second == client_id &&
+                leases.copies.count(work_id) == 0) {
+            BOOST_LOG_TRIVIAL(warning) << "workitem " << work_id
+                << " requeued";
+            if (journal)
+                journal->requeued(work_id);
+            leases.requeued.push_back(work_id);
+            leases.start_times.erase(work_id);
+            leases.to_do.erase(owner);
+        }
+        return;
+    }
+    auto result = std::move(*decoded);
+    if (retry_failed(work_id, result, client_id, leases, journal))
+        return;
+    if (result.is_timed_out()) {
+        BOOST_LOG_TRIVIAL(warning) << "workitem " << work_id
+            << " timed out";
+        if (journal)
+            journal->timed_out(work_id);
+    }
+    BOOST_LOG_TRIVIAL(info) << "workitem " << work_id
+        << " done: " << result.exit_status();
+    if (journal)
+        journal->done(work_id, result.exit_status());
+    writer.write(work_id, std::move(result));
+    leases.is_done[work_id] = true;
+    // other clients that run the work item cancel it
+    auto copy = leases.copies.find(work_id);
+    if (copy != leases.copies.end()) {
+        auto owner = leases.to_do.find(work_id);
+        if (owner != leases.to_do.end())
+            copy->second.insert(owner->second);
+        for (const auto& copy_client_id: copy->second)
+            if (copy_client_id != client_id)
+                leases.to_cancel.emplace_back(copy_client_id, work_id);
+        leases.copies.erase(copy);
+    }
+    leases.to_do.erase(work_id);
+    leases.start_times.erase(work_id);
+}
+
+bool retry_failed(size_t work_id, const wpr::Result& result,
+        const Uuid& client_id, Lease_state& leases, worker::Journal* journal) {
+    const auto& retry = leases.retry;
+    int exit_status = result.exit_status();
+    if (exit_status == 0 ||
+            (!retry.exit_codes.empty() && retry.exit_codes.count(exit_status) == 0))
+        return false;
+    auto& nr_failed = leases.nr_failed[work_id];
+    if (nr_failed + 1 >= retry.max_attempts)
+        return false;
+    ++nr_failed;
+    leases.failed_on[work_id].insert(client_id);
+    // the output of the attempt is dropped, including its spill files
+    if (!result.is_stored()) {
+        boost::system::error_code err;
+        for (const auto* file: {&result.stdout_file(), &result.stderr_file()})
+            if (!file->name.empty())
+                boost::filesystem::remove(file->name, err);
+    }
+    // when a copy of the work item runs on another client, it takes over
+    auto owner = leases.to_do.find(work_id);
+    auto copy = leases.copies.find(work_id);
+    if (copy != leases.copies.end()) {
+        copy->second.erase(client_id);
+        if (owner != leases.to_do.end() && owner->second == client_id &&
+                !copy->second.empty()) {
+            owner->second = *copy->second.begin();
+            copy->second.erase(copy->second.begin());
+        }
+        if (copy->second.empty())
+            leases.copies.erase(copy);
+    }
+    // a work item that runs elsewhere, or was requeued in the meantime,
+    // is not retried again
+    if (owner == leases.to_do.end() || owner->second != client_id) {
+        BOOST_LOG_TRIVIAL(warning) << "workitem " << work_id
+            << " failed: " << exit_status << ", attempt " << nr_failed
+            << " of " << retry.max_attempts << ", still running";
+        return true;
+    }
+    auto backoff = retry.backoff*(long {1} << std::min(nr_failed - 1,
+                                                       max_backoff_doublings));
+    BOOST_LOG_TRIVIAL(warning) << "workitem " << work_id
+        << " failed: " << exit_status << ", attempt " << nr_failed
+        << " of " << retry.max_attempts << ", retried in "
+        << backoff.count() << " s";
+    if (journal)
+        journal->requeued(work_id);
+    leases.delayed.emplace(std::chrono::steady_clock::now() + backoff, work_id);
+    leases.to_do.erase(owner);
+    leases.start_times.erase(work_id);
+    return true;
+}
+
+std::set<int> parse_exit_codes(const std::string& codes_str) {
+    std::set<int> exit_codes;
+    size_t offset {0};
+    while (offset < codes_str.length()) {
+        size_t end = codes_str.find(',', offset);
+        if (end == std::string::npos)
+            end = codes_str.length();
+        int exit_code;
+        auto [ptr, err] = std::from_chars(codes_str.data() + offset,
+                                          codes_str.data() + end, exit_code);
+        if (err != std::errc() || ptr != codes_str.data() + end)
+            throw std::invalid_argument("invalid exit status");
+        exit_codes.insert(exit_code);
+        offset = end + 1;
+    }
+    return exit_codes;
+}
+
+/*
+  When all work items were sent, clients that ask for work would be idle
+  until the job ends, while a few slow work items, e.g., on a degraded
+  node, may keep it running.  When speculative copies are enabled, these
+  clients get copies of the work items that were sent longest ago instead,
+  up to a maximum number of copies per work item.  The first result is
+  kept, and the other clients that run the work item are told to cancel
+  it.  When a client whose lease expires runs a work item that has
+  copies, one of these takes over, so it is not requeued.
+ */
+size_t dispatch_copies(zmq::socket_t& socket, const Address& address,
+        const Uuid& dest, size_t nr_requested,
+        const wp::Work_file& work_file, wm::Message_builder& msg_builder,
+        Lease_state& leases) {
+    // clients whose lease expired are not sent copies, they may be lost
+    if (leases.last_seen.count(dest) == 0)
+        return 0;
+    // the work items that were sent longest ago are copied first, a
+    // client gets a single copy of a work item, and not one it runs
+    std::vector<std::pair<std::chrono::steady_clock::time_point, size_t>> candidates;
+    for (const auto& [work_id, client_id]: leases.to_do) {
+        if (client_id == dest)
+            continue;
+        auto copy = leases.copies.find(work_id);
+        if (copy != leases.copies.end() &&
+                (copy->second.size() >= leases.max_copies ||
+                 copy->second.count(dest) > 0))
+            continue;
+        candidates.emplace_back(leases.start_times[work_id], work_id);
+    }
+    size_t nr_sent = std::min(nr_requested, candidates.size());
+    std::partial_sort(candidates.begin(), candidates.begin() + nr_sent,
+                      candidates.end());
+    for (size_t i = 0; i < nr_sent; ++i) {
+        size_t work_id = candidates[i].second;
+        leases.copies[work_id].insert(dest);
+        BOOST_LOG_TRIVIAL(info) << "workitem " << work_id
+            << " copy started: " << dest;
+        send_work(socket, address, dest, work_id,
+                  std::string(work_file.item(work_id)), msg_builder);
+    }
+    return nr_sent;
+}
+
+void send_cancels(zmq::socket_t& socket, wm::Message_builder& msg_builder,
+        Lease_state& leases, bool is_done) {
+    // once all work items are done, queries for new work are no longer
+    // answered, so clients that cancel a work item are stopped as well
+    std::set<Uuid> cancelled;
+    for (const auto& [client_id, work_id]: leases.to_cancel) {
+        auto address = leases.addresses.find(client_id);
+        if (address == leases.addresses.end())
+            continue;
+        BOOST_LOG_TRIVIAL(info) << "workitem " << work_id
+            << " cancelled: " << client_id;
+        auto cancel_msg = msg_builder.to(client_id)
+            .subject(wm::Subject::cancel).id(work_id).build();
+        if (!send_message(socket, address->second, std::move(cancel_msg)))
+            BOOST_LOG_TRIVIAL(error) << "server could not send cancel message";
+        if (is_done && cancelled.insert(client_id).second)
+            send_stop(socket, address->second, client_id, msg_builder);
+    }
+    leases.to_cancel.clear();
+}
+
+void send_work(zmq::socket_t& socket, const Address& address,
+        const Uuid& dest, size_t work_id, std::string work_item,
+        wm::Message_builder& msg_builder) {
     msg_builder.to(dest).subject(wm::Subject::work)
-        .id(work_id) .content(work_item);
+        .id(work_id) .content(std::move(work_item));
     auto work_msg = msg_builder.build();
-    BOOST_LOG_TRIVIAL(info) << "work message " << work_id
+    BOOST_LOG_TRIVIAL(debug) << "work message " << work_id
                                 << " to " << work_msg.to();
-    auto send_result = socket.send(pack_message(work_msg), zmq::send_flags::none);
+    auto send_result = send_message(socket, address, std::move(work_msg));
     if (!send_result) {
-        BOOST_LOG_TRIVIAL(error) << "server could not send work messag";
+        BOOST_LOG_TRIVIAL(error) << "server could not send work message";
     }
-    return work_id;
 }
 
-void send_stop(zmq::socket_t& socket, const Uuid& dest,
+void send_work_chunk(zmq::socket_t& socket, const Address& address,
+        const Uuid& dest, const wm::Chunk& chunk,
         wm::Message_builder& msg_builder) {
+    msg_builder.to(dest).subject(wm::Subject::work_chunk)
+        .id(chunk.front().first).content(wm::encode_chunk(chunk));
+    auto work_msg = msg_builder.build();
+    BOOST_LOG_TRIVIAL(debug) << "work_chunk message " << chunk.front().first
+                                << "-" << chunk.back().first
+                                << " to " << work_msg.to();
+    auto send_result = send_message(socket, address, std::move(work_msg));
+    if (!send_result) {
+        BOOST_LOG_TRIVIAL(error) << "server could not send work_chunk message";
+    }
+}
+
+void send_stop(zmq::socket_t& socket, const Address& address,
+        const Uuid& dest, wm::Message_builder& msg_builder) {
     msg_builder.to(dest).subject(wm::Subject::stop);
     auto stop_msg = msg_builder.build();
-    BOOST_LOG_TRIVIAL(info) << "stop message to "
+    BOOST_LOG_TRIVIAL(debug) << "stop message to "
                                 << stop_msg.to();
-    auto send_result = socket.send(pack_message(stop_msg), zmq::send_flags::none);
+    auto send_result = send_message(socket, address, std::move(stop_msg));
     if (!send_result) {
         BOOST_LOG_TRIVIAL(error) << "server could not send stop message";
     }
 }
 
-void send_ack(zmq::socket_t& socket, const Uuid& dest,
-        wm::Message_builder& msg_builder) {
+void send_ack(zmq::socket_t& socket, const Address& address,
+        const Uuid& dest, wm::Message_builder& msg_builder) {
     auto ack_msg = msg_builder.to(dest).subject(wm::Subject::ack).build();
-    auto send_result = socket.send(pack_message(ack_msg), zmq::send_flags::none);
+    auto send_result = send_message(socket, address, std::move(ack_msg));
     if (!send_result) {
         BOOST_LOG_TRIVIAL(error) << "server could not send ack message";
     }
 }
 
-void send_ack_stop(zmq::socket_t& socket, const Uuid& dest,
-        wm::Message_builder& msg_builder) {
+void send_ack_stop(zmq::socket_t& socket, const Address& address,
+        const Uuid& dest, wm::Message_builder& msg_builder) {
     auto ack_msg = msg_builder.to(dest).subject(wm::Subject::ack_stop).build();
-    auto send_result = socket.send(pack_message(ack_msg), zmq::send_flags::none);
+    auto send_result = send_message(socket, address, std::move(ack_msg));
     if (!send_result) {
         BOOST_LOG_TRIVIAL(error) << "server could not send ack message";
     }
 }
+
+void send_heartbeat(zmq::socket_t& socket, const Address& address,
+        const Uuid& dest, wm::Message_builder& msg_builder) {
+    auto heartbeat_msg = msg_builder.to(dest).subject(wm::Subject::heartbeat)
+        .build();
+    auto send_result = send_message(socket, address, std::move(heartbeat_msg));
+    if (!send_result) {
+        BOOST_LOG_TRIVIAL(error) << "server could not send heartbeat message";
+    }
+}
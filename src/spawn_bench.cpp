@@ -0,0 +1,81 @@
+#include <boost/process/environment.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "work_processor/processor.h"
+
+/*
+  Time launching trivial work items in non-login shells, so that the
+  profiles don't dominate, with boost::process as process_work does, and
+  with posix_spawn as Launcher does.  The work items are spread over a
+  number of threads, as the slots of a client would.
+ */
+
+namespace wpr = worker::work_processor;
+
+using Run_item = std::function<int(const std::string&, size_t)>;
+
+double time_launches(const std::string& name, size_t nr_items,
+                     size_t nr_threads,
+                     const std::function<Run_item()>& make_runner) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (size_t thread_nr = 0; thread_nr < nr_threads; ++thread_nr)
+        threads.emplace_back([&, thread_nr] {
+            auto run_item = make_runner();
+            for (size_t work_id = thread_nr + 1; work_id <= nr_items;
+                    work_id += nr_threads)
+                if (run_item("echo $WORKER_ITEM_ID", work_id) != 0)
+                    std::cerr << "### error: work item " << work_id
+                        << " failed" << std::endl;
+        });
+    for (auto& thread: threads)
+        thread.join();
+    auto end = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double>(end - start).count();
+    std::cout << name << ": " << nr_items << " work items, " << nr_threads
+        << " threads: " << elapsed << " s, "
+        << 1.0e3*elapsed/nr_items << " ms per work item" << std::endl;
+    return elapsed;
+}
+
+int main(int argc, char* argv[]) {
+    size_t nr_items = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000;
+    size_t nr_threads = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1;
+    if (nr_items == 0 || nr_threads == 0) {
+        std::cerr << "### error: number of work items and threads should "
+                  << "be positive" << std::endl;
+        return 1;
+    }
+    const wpr::Output_options output_options;
+    wpr::Shell_options shell_options;
+    shell_options.is_login = false;
+    wpr::Env base_env = boost::this_process::environment();
+
+    double boost_time = time_launches("boost::process", nr_items, nr_threads,
+            [&] () -> Run_item {
+                auto env = std::make_shared<wpr::Env>(base_env);
+                return [=, &output_options] (const std::string& work_item,
+                                             size_t work_id) {
+                    (*env)["WORKER_ITEM_ID"] = std::to_string(work_id);
+                    return wpr::process_work(work_item, *env, output_options,
+                                             shell_options).exit_status();
+                };
+            });
+    double spawn_time = time_launches("posix_spawn", nr_items, nr_threads,
+            [&] () -> Run_item {
+                auto launcher = std::make_shared<wpr::Launcher>(
+                        base_env, output_options, false);
+                return [launcher] (const std::string& work_item,
+                                   size_t work_id) {
+                    return launcher->run(work_item, work_id).exit_status();
+                };
+            });
+    std::cout << "speedup: " << boost_time/spawn_time << std::endl;
+    return 0;
+}
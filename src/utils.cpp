@@ -1,11 +1,21 @@
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
 #include <iostream>
+#include <mutex>
+#include <thread>
 
 #define BOOST_LOG_DYN_LINK 1
 #include <boost/log/core.hpp>
 #include <boost/log/trivial.hpp>
 #include <boost/log/expressions.hpp>
+#include <boost/log/sinks/async_frontend.hpp>
+#include <boost/log/sinks/block_on_overflow.hpp>
+#include <boost/log/sinks/bounded_fifo_queue.hpp>
 #include <boost/log/sinks/text_file_backend.hpp>
 #include <boost/log/utility/setup/file.hpp>
+#include <boost/log/utility/setup/formatter_parser.hpp>
 #include <boost/log/utility/setup/common_attributes.hpp>
 #include <boost/log/sources/severity_logger.hpp>
 #include <boost/log/sources/severity_feature.hpp>
@@ -29,32 +39,170 @@ void print_version_info() {
         << zmq_patch << std::endl;
 }
 
-wm::Message unpack_message(const zmq::message_t& zmq_msg,
+wm::Message unpack_message(const zmq::message_t& header,
+                           const zmq::message_t& content,
                            const wm::Message_builder& msg_builder) {
-    std::string msg_str;
-    msg_str.resize(zmq_msg.size());
-    memcpy(&msg_str[0], zmq_msg.data(), zmq_msg.size());
-    return msg_builder.build(std::string(msg_str));
+    return msg_builder.build(header.to_string_view(), content.to_string());
 }
 
-zmq::message_t pack_message(const wm::Message& msg) {
-    std::string msg_str = msg.to_string();
-    size_t msg_length = msg_str.length();
-    zmq::message_t zmq_msg(msg_length);
-    memcpy(zmq_msg.data(), &msg_str[0], msg_length);
-    return zmq_msg;
+// content smaller than this is copied into the 0MQ frame, larger content
+// is handed over to 0MQ, which frees it once it has been sent
+const size_t zero_copy_size {4096};
+
+void free_content(void*, void* content) {
+    delete static_cast<std::string*>(content);
+}
+
+zmq::message_t pack_content(wm::Message& msg) {
+    if (msg.length() < zero_copy_size)
+        return zmq::message_t(msg.content().data(), msg.length());
+    auto content = new std::string(msg.release_content());
+    return zmq::message_t(content->data(), content->length(),
+                          free_content, content);
+}
+
+bool send_message(zmq::socket_t& socket, wm::Message&& msg) {
+    zmq::message_t delimiter;
+    if (!socket.send(delimiter, zmq::send_flags::sndmore))
+        return false;
+    if (!socket.send(zmq::buffer(msg.header()), zmq::send_flags::sndmore))
+        return false;
+    return socket.send(pack_content(msg), zmq::send_flags::none).has_value();
+}
+
+bool send_message(zmq::socket_t& socket, const Address& address,
+                  wm::Message&& msg) {
+    if (!socket.send(zmq::buffer(address), zmq::send_flags::sndmore))
+        return false;
+    return send_message(socket, std::move(msg));
+}
+
+std::optional<wm::Message> recv_message(zmq::socket_t& socket,
+        const wm::Message_builder& msg_builder) {
+    // skip the empty delimiter frame, but don't insist on it being there
+    zmq::message_t header;
+    do {
+        if (!socket.recv(header, zmq::recv_flags::none))
+            return std::nullopt;
+    } while (header.size() == 0 && header.more());
+    zmq::message_t content;
+    if (header.more() && !socket.recv(content, zmq::recv_flags::none))
+        return std::nullopt;
+    // discard trailing frames, if any, to stay in sync with the sender
+    bool more = content.more();
+    while (more) {
+        zmq::message_t extra;
+        if (!socket.recv(extra, zmq::recv_flags::none))
+            break;
+        more = extra.more();
+    }
+    return unpack_message(header, content, msg_builder);
 }
 
-void init_logging(const std::string& file_name) {
+std::optional<wm::Message> recv_message(zmq::socket_t& socket,
+        Address& address, const wm::Message_builder& msg_builder) {
+    zmq::message_t identity;
+    if (!socket.recv(identity, zmq::recv_flags::none))
+        return std::nullopt;
+    address = identity.to_string();
+    if (!identity.more())
+        return std::nullopt;
+    return recv_message(socket, msg_builder);
+}
+
+/*
+  Log records are written by a thread of the sink, the threads that log
+  only add them to a bounded queue, and the file is flushed periodically
+  rather than for each record.  When the queue is full, debug and trace
+  records are dropped, others block until there is room.  Info records
+  are never dropped, since the state of work items is logged at that
+  level, and resuming a job, as well as the tools that summarize it,
+  rely on it.  Both are counted, and reported when logging stops.
+ */
+namespace {
+
     namespace logging = boost::log;
+    namespace sinks = boost::log::sinks;
+
+    // maximum number of records in the queue of the sink
+    const size_t log_queue_size {64*1024};
+    // time between flushes of the log file
+    const std::chrono::milliseconds log_flush_interval {1000};
+
+    std::atomic<size_t> nr_dropped_records {0};
+    std::atomic<size_t> nr_blocked_records {0};
+
+    class Log_overflow : public sinks::block_on_overflow {
+        public:
+            template<typename LockT>
+            bool on_overflow(const logging::record_view& record, LockT& lock) {
+                auto severity = record[logging::trivial::severity];
+                if (severity && *severity < logging::trivial::info) {
+                    ++nr_dropped_records;
+                    return false;
+                }
+                ++nr_blocked_records;
+                return block_on_overflow::on_overflow(record, lock);
+            }
+    };
+
+    using Log_sink = sinks::asynchronous_sink<sinks::text_file_backend,
+          sinks::bounded_fifo_queue<log_queue_size, Log_overflow>>;
+
+    boost::shared_ptr<Log_sink> log_sink;
+    std::thread log_flusher;
+    std::mutex log_mutex;
+    std::condition_variable log_stopped;
+    bool is_log_stopped {false};
+
+    void flush_log() {
+        std::unique_lock<std::mutex> lock(log_mutex);
+        while (!log_stopped.wait_for(lock, log_flush_interval,
+                                     [] { return is_log_stopped; }))
+            log_sink->flush();
+    }
+
+    // at exit, the loggers may be gone already, so no records are logged
+    void stop_sink() {
+        if (!log_sink)
+            return;
+        {
+            std::lock_guard<std::mutex> lock(log_mutex);
+            is_log_stopped = true;
+        }
+        log_stopped.notify_one();
+        log_flusher.join();
+        logging::core::get()->remove_sink(log_sink);
+        log_sink->stop();
+        log_sink->flush();
+        log_sink.reset();
+    }
+
+}
+
+void init_logging(const std::string& file_name,
+        boost::log::trivial::severity_level level) {
     namespace keywords = boost::log::keywords;
-    logging::add_file_log(
+    auto backend = boost::make_shared<sinks::text_file_backend>(
             keywords::file_name = file_name,
-            keywords::auto_flush = true,
-            keywords::format = "%TimeStamp% [%Severity%]: %Message%"
+            keywords::auto_flush = false
     );
+    log_sink = boost::make_shared<Log_sink>(backend);
+    log_sink->set_formatter(logging::parse_formatter(
+                "%TimeStamp% [%Severity%]: %Message%"));
+    logging::core::get()->add_sink(log_sink);
     logging::core::get()->set_filter(
-            logging::trivial::severity >= logging::trivial::info
+            logging::trivial::severity >= level
     );
     logging::add_common_attributes();
+    log_flusher = std::thread(flush_log);
+    std::atexit(stop_sink);
+}
+
+void stop_logging() {
+    if (!log_sink)
+        return;
+    BOOST_LOG_TRIVIAL(info) << "log records dropped: " << nr_dropped_records
+        << ", blocked: " << nr_blocked_records;
+    stop_sink();
 }
@@ -1,20 +1,79 @@
 #ifndef UTILS_HDR
 #define UTILS_HDR
 
+#include <boost/log/trivial.hpp>
 #include <exception>
+#include <optional>
+#include <string>
 #include <zmq.hpp>
 
 #include "message.h"
 
 void print_version_info();
 
+/*!
+  \brief build a message from its header and content frames.
+ */
 worker::message::Message unpack_message(
-        const zmq::message_t& zmq_msg,
+        const zmq::message_t& header,
+        const zmq::message_t& content,
         const worker::message::Message_builder& msg_builder
 );
 
-zmq::message_t pack_message(const worker::message::Message& msg);
+/*!
+  \brief routing identity of a peer as seen by a ROUTER socket
+ */
+using Address = std::string;
 
-void init_logging(const std::string& file_name);
+/*!
+  \brief send a message over a DEALER socket, using the same envelope
+         as a REQ socket, i.e., an empty delimiter frame followed by the
+         message's header and content frames.  The message's content
+         is handed over to 0MQ without copying it, so the message is
+         moved from.
+ */
+bool send_message(zmq::socket_t& socket,
+        worker::message::Message&& msg);
+
+/*!
+  \brief send a message over a ROUTER socket to the peer with the given
+         address, the message is moved from.
+ */
+bool send_message(zmq::socket_t& socket, const Address& address,
+        worker::message::Message&& msg);
+
+/*!
+  \brief receive a message from a DEALER socket, returns no value if no
+         message could be received.
+ */
+std::optional<worker::message::Message> recv_message(
+        zmq::socket_t& socket,
+        const worker::message::Message_builder& msg_builder
+);
+
+/*!
+  \brief receive a message from a ROUTER socket, the peer's address is
+         stored in address, returns no value if no message could be
+         received.
+ */
+std::optional<worker::message::Message> recv_message(
+        zmq::socket_t& socket, Address& address,
+        const worker::message::Message_builder& msg_builder
+);
+
+/*!
+  \brief set up logging to a file, records are written asynchronously.
+  \param file_name std::string name of the log file.
+  \param level severity_level of the least severe records to log.
+ */
+void init_logging(const std::string& file_name,
+        boost::log::trivial::severity_level level);
+
+/*!
+  \brief log the number of records that were dropped or blocked, write
+         the queued log records, and stop logging.  The queued records
+         are written at exit as well.
+ */
+void stop_logging();
 
 #endif
@@ -0,0 +1,52 @@
+/*!
+  \file
+  \brief Helper functions for the binary wire format
+ */
+#ifndef WIRE_HDR
+#define WIRE_HDR
+
+#include <cstdint>
+#include <string>
+
+namespace worker {
+    namespace wire {
+
+        /*!
+          \brief version of the binary wire format, it is the first byte
+                 of each message header, so that peers built from
+                 different versions of worker-ng detect the mismatch.
+         */
+        const std::uint8_t version {1};
+
+        /*!
+          \brief append an unsigned integer to a buffer, in little endian
+                 byte order, regardless of the host's byte order.
+          \param buffer std::string& to append to.
+          \param value unsigned integer to append.
+          \param nr_bytes size_t number of bytes to use.
+         */
+        inline void put_uint(std::string& buffer, std::uint64_t value,
+                             size_t nr_bytes) {
+            for (size_t i = 0; i < nr_bytes; ++i)
+                buffer.push_back(static_cast<char>((value >> (8*i)) & 0xFF));
+        }
+
+        /*!
+          \brief read an unsigned integer in little endian byte order.
+          \param data const char* pointer to the first byte, the caller
+                 ensures that nr_bytes can be read.
+          \param nr_bytes size_t number of bytes to read.
+          \return value that was read.
+         */
+        inline std::uint64_t get_uint(const char* data, size_t nr_bytes) {
+            std::uint64_t value {0};
+            for (size_t i = 0; i < nr_bytes; ++i)
+                value |= static_cast<std::uint64_t>(
+                        static_cast<unsigned char>(data[i])) << (8*i);
+            return value;
+        }
+
+    }
+}
+
+#endif
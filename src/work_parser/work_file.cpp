@@ -0,0 +1,156 @@
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iterator>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "work_file.h"
+#include "../wire.h"
+
+namespace worker {
+    namespace work_parser {
+
+        const std::string Work_file::DEFAULT_SEP {"#WORKER----"};
+
+        // identifies index files, and their format version
+        static const std::string INDEX_MAGIC {"WRKIDX01"};
+
+        Work_file::Work_file(const std::string& file_name) :
+            Work_file(file_name, DEFAULT_SEP) {}
+
+        Work_file::Work_file(const std::string& file_name,
+                             const std::string& separator) :
+            sep_ {separator} {
+            int fd = open(file_name.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0)
+                throw work_file_exception("can not open work file");
+            struct stat file_stat;
+            if (fstat(fd, &file_stat) != 0) {
+                close(fd);
+                throw work_file_exception("can not stat work file");
+            }
+            size_ = file_stat.st_size;
+            if (size_ > 0) {
+                void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (data == MAP_FAILED) {
+                    close(fd);
+                    throw work_file_exception("can not map work file");
+                }
+                data_ = static_cast<const char*>(data);
+                // work items are mostly read in order
+                madvise(data, size_, MADV_SEQUENTIAL);
+            }
+            close(fd);
+            long mtime = file_stat.st_mtim.tv_sec*1000000000L +
+                         file_stat.st_mtim.tv_nsec;
+            const std::string index_name {file_name + ".idx"};
+            is_index_cached_ = read_index(index_name, mtime);
+            if (!is_index_cached_) {
+                build_index();
+                write_index(index_name, mtime);
+            }
+        }
+
+        Work_file::~Work_file() {
+            if (data_ != nullptr)
+                munmap(const_cast<char*>(data_), size_);
+        }
+
+        std::string_view Work_file::item(size_t id) const {
+            if (id < 1 || id > nr_items())
+                return std::string_view();
+            size_t start = offsets_[id - 1];
+            // items are followed by a separator line, except the last
+            size_t end = id < nr_items() ? offsets_[id] - sep_.length() - 1
+                                         : offsets_[id];
+            return std::string_view(data_ + start, end - start);
+        }
+
+        void Work_file::build_index() {
+            offsets_.clear();
+            size_t item_start {0};
+            size_t item_end {0};
+            size_t pos {0};
+            while (pos < size_) {
+                const char* newline = static_cast<const char*>(
+                        std::memchr(data_ + pos, '\n', size_ - pos));
+                size_t line_end = newline ? newline - data_ : size_;
+                size_t next = newline ? line_end + 1 : size_;
+                if (line_end - pos == sep_.length() &&
+                        std::memcmp(data_ + pos, sep_.data(), sep_.length()) == 0) {
+                    // an empty work item ends the work file
+                    if (pos == item_start)
+                        break;
+                    offsets_.push_back(item_start);
+                    item_end = pos;
+                    item_start = next;
+                }
+                pos = next;
+            }
+            if (pos >= size_ && item_start < size_) {
+                offsets_.push_back(item_start);
+                item_end = size_;
+            }
+            offsets_.push_back(item_end);
+        }
+
+        bool Work_file::read_index(const std::string& index_name, long mtime) {
+            std::ifstream ifs(index_name, std::ios::binary);
+            if (!ifs)
+                return false;
+            std::string header(INDEX_MAGIC.length() + 4*8 + sep_.length(), '\0');
+            if (!ifs.read(&header[0], header.length()))
+                return false;
+            const char* data = header.data() + INDEX_MAGIC.length();
+            if (header.compare(0, INDEX_MAGIC.length(), INDEX_MAGIC) != 0 ||
+                    wire::get_uint(data, 8) != size_ ||
+                    wire::get_uint(data + 8, 8) != static_cast<std::uint64_t>(mtime) ||
+                    wire::get_uint(data + 16, 8) != sep_.length() ||
+                    header.compare(header.length() - sep_.length(),
+                                   sep_.length(), sep_) != 0)
+                return false;
+            size_t nr_offsets = wire::get_uint(data + 24, 8);
+            std::string offsets(8*nr_offsets, '\0');
+            if (nr_offsets == 0 || !ifs.read(&offsets[0], offsets.length()))
+                return false;
+            offsets_.resize(nr_offsets);
+            for (size_t i = 0; i < nr_offsets; ++i) {
+                offsets_[i] = wire::get_uint(offsets.data() + 8*i, 8);
+                if (offsets_[i] > size_) {
+                    offsets_.clear();
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        void Work_file::write_index(const std::string& index_name,
+                                    long mtime) const {
+            std::string index {INDEX_MAGIC};
+            index.reserve(INDEX_MAGIC.length() + 4*8 + sep_.length() +
+                          8*offsets_.size());
+            wire::put_uint(index, size_, 8);
+            wire::put_uint(index, static_cast<std::uint64_t>(mtime), 8);
+            wire::put_uint(index, sep_.length(), 8);
+            wire::put_uint(index, offsets_.size(), 8);
+            index.append(sep_);
+            for (auto offset: offsets_)
+                wire::put_uint(index, offset, 8);
+            // write to a temporary file first, so that concurrent readers
+            // never see a partial index
+            const std::string tmp_name {index_name + "." +
+                                        std::to_string(getpid())};
+            std::ofstream ofs(tmp_name, std::ios::binary);
+            if (!ofs)
+                return;
+            ofs.write(index.data(), index.length());
+            ofs.close();
+            if (!ofs || std::rename(tmp_name.c_str(), index_name.c_str()) != 0)
+                std::remove(tmp_name.c_str());
+        }
+
+    }
+}
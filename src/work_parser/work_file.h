@@ -0,0 +1,136 @@
+/*!
+  \file
+  \brief Work file with random access to its work items
+ */
+#ifndef WORK_FILE_HDR
+#define WORK_FILE_HDR
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../worker_exception.h"
+
+namespace worker {
+    namespace work_parser {
+
+        /*!
+          \brief Work file that is memory mapped, and indexed by the
+                 offsets of its work items.
+
+          The index is built by a single scan of the work file, and stored
+          next to it, with the extension .idx, so that it can be reused as
+          long as the work file and the separator don't change.  Work
+          items are returned as views into the mapped file, so accessing a
+          work item neither copies it, nor reads the work items before it.
+
+          As for Work_parser, work items are separated by lines that
+          consist of the separator, and the work file ends at the first
+          empty work item.
+         */
+        class Work_file {
+            public:
+                /*!
+                  \brief Work_file constructor, maps the file and loads or
+                         builds its index.
+                  \param file_name std::string name of the work file.
+                  \param separator std::string representing the separator
+                         between the individual work items.
+                  \throw work_file_exception if the file can not be opened
+                         or mapped.
+                 */
+                Work_file(const std::string& file_name,
+                          const std::string& separator);
+
+                /*!
+                  \brief Work_file constructor that uses the default work
+                         item separator.
+                  \param file_name std::string name of the work file.
+                  \throw work_file_exception if the file can not be opened
+                         or mapped.
+                 */
+                explicit Work_file(const std::string& file_name);
+
+                /*!
+                  \brief Work_file destructor, unmaps the file.
+                 */
+                ~Work_file();
+
+                Work_file(const Work_file&) = delete;
+                Work_file& operator=(const Work_file&) = delete;
+
+                /*!
+                  \brief returns the number of work items in the file.
+                  \return number of work items.
+                 */
+                size_t nr_items() const { return offsets_.size() - 1; };
+
+                /*!
+                  \brief returns a work item.
+                  \param id size_t ID of the work item, starting from 1.
+                  \return view of the work item in the mapped file, it is
+                          valid as long as the Work_file exists.
+                 */
+                std::string_view item(size_t id) const;
+
+                /*!
+                  \brief returns the separator between work items.
+                  \return separator.
+                 */
+                const std::string& separator() const { return sep_; };
+
+                /*!
+                  \brief returns whether the index was loaded from its
+                         cache file rather than built.
+                  \return true if the cached index was used.
+                 */
+                bool is_index_cached() const { return is_index_cached_; };
+
+            private:
+                //! default separator
+                static const std::string DEFAULT_SEP;
+                //! separator between work items
+                std::string sep_;
+                //! start of the mapped file, nullptr for an empty file
+                const char* data_ {nullptr};
+                //! size of the mapped file
+                size_t size_ {0};
+                //! offset of each work item, and of the end of the last
+                std::vector<size_t> offsets_;
+                //! true if the index was read from its cache file
+                bool is_index_cached_ {false};
+                /*!
+                  \brief scans the mapped file for separators.
+                 */
+                void build_index();
+                /*!
+                  \brief reads the index from the cache file, if it is
+                         valid for this work file.
+                  \param index_name std::string name of the cache file.
+                  \param mtime modification time of the work file.
+                  \return true if the index was read.
+                 */
+                bool read_index(const std::string& index_name, long mtime);
+                /*!
+                  \brief writes the index to the cache file, failure is
+                         not an error, the index is built next time.
+                  \param index_name std::string name of the cache file.
+                  \param mtime modification time of the work file.
+                 */
+                void write_index(const std::string& index_name,
+                                 long mtime) const;
+        };
+
+        /*!
+          \brief Exception to be thrown when a work file can not be read.
+         */
+        class work_file_exception : public Worker_exception {
+            public:
+                explicit work_file_exception(const char* msg) :
+                    Worker_exception(msg) {};
+        };
+
+    }
+}
+
+#endif
@@ -10,16 +10,74 @@ namespace worker {
         void Work_parser::parse_next() {
             std::stringstream item {""};
             std::string line;
-            while (std::getline(ifs_, line) && line != sep_) {
+            while (std::getline(*ifs_, line) && line != sep_) {
                 item << line << "\n";
             }
             next_item_ = item.str();
         }
 
+        void Work_parser::skip(std::vector<bool> completed) {
+            completed_ = std::move(completed);
+            skip_completed();
+        }
+
+        void Work_parser::prioritize(const std::vector<double>& estimates) {
+            if (!work_file_)
+                return;
+            double total {0.0};
+            size_t nr_known {0};
+            for (size_t id = 1; id < estimates.size(); ++id)
+                if (id <= work_file_->nr_items() && estimates[id] >= 0.0) {
+                    total += estimates[id];
+                    ++nr_known;
+                }
+            const double mean {nr_known > 0 ? total/nr_known : 0.0};
+            std::vector<Estimate> items;
+            for (size_t id = next_id_; id <= work_file_->nr_items(); ++id) {
+                if (id < completed_.size() && completed_[id]) {
+                    ++nr_skipped_;
+                    continue;
+                }
+                double estimate = id < estimates.size() ? estimates[id] : -1.0;
+                items.emplace_back(estimate >= 0.0 ? estimate : mean, id);
+            }
+            by_estimate_ = decltype(by_estimate_)(Shorter(), std::move(items));
+            next_id_ = work_file_->nr_items() + 1;
+            is_prioritized_ = true;
+        }
+
+        void Work_parser::skip_completed() {
+            if (!work_file_)
+                return;
+            while (next_id_ < completed_.size() && completed_[next_id_] &&
+                    next_id_ <= work_file_->nr_items()) {
+                ++next_id_;
+                ++nr_skipped_;
+            }
+        }
+
         std::string Work_parser::next() {
+            if (is_prioritized_) {
+                if (by_estimate_.empty())
+                    return std::string();
+                nr_items_ = by_estimate_.top().second;
+                by_estimate_.pop();
+                ++nr_provided_;
+                return std::string(work_file_->item(nr_items_));
+            }
+            if (work_file_) {
+                if (!has_next())
+                    return std::string();
+                nr_items_ = next_id_++;
+                ++nr_provided_;
+                skip_completed();
+                return std::string(work_file_->item(nr_items_));
+            }
             std::string result {next_item_};
-            if (result.length() > 0)
+            if (result.length() > 0) {
                 ++nr_items_;
+                ++nr_provided_;
+            }
             parse_next();
             return result;
         }
@@ -6,6 +6,12 @@
 #define WORK_PARSER_HDR
 
 #include <istream>
+#include <queue>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "work_file.h"
 
 namespace worker {
     namespace work_parser {
@@ -15,7 +21,8 @@ namespace worker {
 
           A work file is an ASCII-encoded text file that contains bash
           scripts, separated by a marker. Each bash script represents
-          an individual work item.
+          an individual work item.  The work items are either parsed from
+          an input stream, or taken from an indexed Work_file.
          */
         class Work_parser {
             public:
@@ -28,7 +35,7 @@ namespace worker {
                  */
                 Work_parser(std::istream& work_stream,
                         const std::string& separator) :
-                    ifs_ {work_stream}, sep_ {separator}, nr_items_ {0} {
+                    ifs_ {&work_stream}, sep_ {separator}, nr_items_ {0} {
                         parse_next();
                     };
 
@@ -41,12 +48,52 @@ namespace worker {
                 Work_parser(std::istream& work_stream) :
                     Work_parser(work_stream, DEFAULT_SEP) {};
 
+                /*!
+                  \brief Work_parser constructor that takes the work items
+                         from an indexed work file.
+                  \param work_file Work_file& reference to the work file,
+                         it should outlive the Work_parser.
+                 */
+                explicit Work_parser(const Work_file& work_file) :
+                    work_file_ {&work_file}, sep_ {work_file.separator()},
+                    nr_items_ {0} {};
+
                 /*!
                   \brief checks whether the Work_parser has work items left.
                   \return true if the Work_parser has work items left,
                           false otherwise.
                  */
-                bool has_next() const { return next_item_.length() > 0; };
+                bool has_next() const {
+                    if (is_prioritized_)
+                        return !by_estimate_.empty();
+                    return work_file_ ? next_id_ <= work_file_->nr_items()
+                                      : next_item_.length() > 0;
+                };
+
+                /*!
+                  \brief skip work items that have been completed, e.g.,
+                         by a previous run of the same work file.  Work
+                         items keep their IDs.  Only work items taken
+                         from a Work_file can be skipped.
+                  \param completed std::vector<bool> with an element set
+                         for each ID of a completed work item, IDs beyond
+                         its size are not completed.
+                 */
+                void skip(std::vector<bool> completed);
+
+                /*!
+                  \brief return the work items in order of decreasing
+                         estimated walltime rather than in the order of
+                         the work file, ties are broken by ID.  Work items
+                         that were skipped remain skipped.  Only work
+                         items taken from a Work_file can be prioritized.
+                  \param estimates std::vector<double> with the estimated
+                         walltime of each work item indexed by its ID, a
+                         negative value, or an ID beyond its size, means
+                         unknown, such work items are assumed to take the
+                         mean of the known estimates.
+                 */
+                void prioritize(const std::vector<double>& estimates);
 
                 /*!
                   \brief returns the next work item.
@@ -56,12 +103,27 @@ namespace worker {
                 std::string next();
 
                 /*!
-                  \brief returns the number of work items returned so far.
-                  \return number of work items the Work_parser has
-                          provided so far.
+                  \brief returns the ID of the work item returned last.
+                  \return ID of the last work item, unless the work items
+                          are prioritized, this is the number of work
+                          items the Work_parser has provided so far, plus
+                          the number of work items it skipped.
                  */
                 size_t nr_items() const { return nr_items_; };
 
+                /*!
+                  \brief returns the number of work items skipped so far.
+                  \return number of completed work items the Work_parser
+                          skipped so far.
+                 */
+                size_t nr_skipped() const { return nr_skipped_; };
+
+                /*!
+                  \brief returns the number of work items provided so far.
+                  \return number of work items next() returned.
+                 */
+                size_t nr_provided() const { return nr_provided_; };
+
                 /*!
                   \brief returns the separator for the Work_parser.
                   \return string representing the separator used by the
@@ -72,14 +134,43 @@ namespace worker {
             private:
                 //! default separator
                 static const std::string DEFAULT_SEP;
-                //! shared pointer to input stream that contains work items
-                std::istream& ifs_;
+                //! input stream that contains work items, if any
+                std::istream* ifs_ {nullptr};
+                //! indexed work file that contains work items, if any
+                const Work_file* work_file_ {nullptr};
                 //! next work item to be returned by next()
                 std::string next_item_;
                 //! separator used by Work_parser
                 std::string sep_;
-                //! number of items returned so far
+                //! ID of the item returned last
                 size_t nr_items_;
+                //! ID of the item next() will return, for a Work_file
+                size_t next_id_ {1};
+                //! completed items that are skipped, indexed by ID
+                std::vector<bool> completed_;
+                //! number of items skipped so far
+                size_t nr_skipped_ {0};
+                //! number of items returned so far
+                size_t nr_provided_ {0};
+                //! estimated walltime and ID of an item
+                using Estimate = std::pair<double, size_t>;
+                //! orders by estimate, and by reverse ID for equal ones
+                struct Shorter {
+                    bool operator()(const Estimate& a,
+                                    const Estimate& b) const {
+                        return a.first < b.first ||
+                            (a.first == b.first && a.second > b.second);
+                    };
+                };
+                //! true if items are returned by decreasing estimate
+                bool is_prioritized_ {false};
+                //! items that are left, longest first, when prioritized
+                std::priority_queue<Estimate, std::vector<Estimate>,
+                                    Shorter> by_estimate_;
+                /*!
+                  \brief advances next_id_ past completed items
+                 */
+                void skip_completed();
                 /*!
                   \brief parses the istream and sets _next_item
                  */
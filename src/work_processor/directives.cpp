@@ -0,0 +1,66 @@
+#include <cctype>
+
+#include "directives.h"
+
+namespace worker {
+    namespace work_processor {
+
+        static const std::string_view directive_prefix {"#WORKER "};
+
+        std::chrono::seconds parse_duration(std::string_view str) {
+            long seconds {0};
+            int nr_fields {0};
+            size_t pos {0};
+            for (;;) {
+                size_t end = str.find(':', pos);
+                auto field = str.substr(pos, end == std::string_view::npos ?
+                                             std::string_view::npos : end - pos);
+                if (field.empty() || field.length() > 9 ||
+                        ++nr_fields > 3)
+                    throw directive_parse_exception("malformed duration");
+                long value {0};
+                for (char c: field) {
+                    if (!std::isdigit(static_cast<unsigned char>(c)))
+                        throw directive_parse_exception("malformed duration");
+                    value = 10*value + (c - '0');
+                }
+                seconds = 60*seconds + value;
+                if (end == std::string_view::npos)
+                    return std::chrono::seconds(seconds);
+                pos = end + 1;
+            }
+        }
+
+        Directives parse_directives(std::string_view work_item) {
+            Directives directives;
+            size_t pos {0};
+            while (pos < work_item.length()) {
+                size_t end = work_item.find('\n', pos);
+                if (end == std::string_view::npos)
+                    end = work_item.length();
+                auto line = work_item.substr(pos, end - pos);
+                pos = end + 1;
+                if (line.substr(0, directive_prefix.length()) != directive_prefix)
+                    continue;
+                line.remove_prefix(directive_prefix.length());
+                while (!line.empty()) {
+                    size_t setting_end = line.find(' ');
+                    auto setting = line.substr(0, setting_end);
+                    line.remove_prefix(setting_end == std::string_view::npos ?
+                                       line.length() : setting_end + 1);
+                    size_t eq = setting.find('=');
+                    if (eq == std::string_view::npos)
+                        continue;
+                    auto key = setting.substr(0, eq);
+                    auto value = setting.substr(eq + 1);
+                    if (key == "walltime")
+                        directives.walltime = parse_duration(value);
+                    else if (key == "estimate")
+                        directives.estimate = parse_duration(value);
+                }
+            }
+            return directives;
+        }
+
+    }
+}
@@ -0,0 +1,68 @@
+/*!
+  \file
+  \brief Directives that are embedded in work items
+ */
+#ifndef PROCESSOR_DIRECTIVES_HDR
+#define PROCESSOR_DIRECTIVES_HDR
+
+#include <chrono>
+#include <string>
+#include <string_view>
+
+#include "../worker_exception.h"
+
+namespace worker {
+    namespace work_processor {
+
+        /*!
+          \brief settings of a work item given by directives.
+
+          A directive is a line of the work item that starts with
+          "#WORKER ", followed by settings of the form key=value,
+          separated by spaces, e.g.,
+              #WORKER walltime=00:20:00 estimate=00:05:00
+          Since it is a comment, the shell ignores it.
+         */
+        struct Directives {
+            //! maximum walltime of the work item, 0 if not given
+            std::chrono::seconds walltime {0};
+            //! expected walltime of the work item, negative if not given
+            std::chrono::seconds estimate {-1};
+        };
+
+        /*!
+          \brief Exception to be thrown when a directive can not be
+                 parsed.
+         */
+        class directive_parse_exception : public Worker_exception {
+            public:
+                /*!
+                  \brief Exception constructor.
+                  \param message std:string that specifies the specific
+                         inforation about the condition that triggered
+                         the exception.
+                 */
+                directive_parse_exception(const char* message) :
+                    Worker_exception(message) {};
+        };
+
+        /*!
+          \brief parses the directives of a work item.
+          \param work_item std::string_view Bash script of the work item.
+          \return settings of the work item, unknown keys are ignored.
+          \throw directive_parse_exception if a value is malformed.
+         */
+        Directives parse_directives(std::string_view work_item);
+
+        /*!
+          \brief parses a duration of the form [[HH:]MM:]SS.
+          \param str std::string_view duration.
+          \return duration.
+          \throw directive_parse_exception if the duration is malformed.
+         */
+        std::chrono::seconds parse_duration(std::string_view str);
+
+    }
+}
+
+#endif
@@ -0,0 +1,86 @@
+#include <boost/filesystem.hpp>
+#include <cerrno>
+#include <system_error>
+
+#include "output_store.h"
+
+namespace worker {
+    namespace work_processor {
+
+        Output_store::Output_store(const std::string& prefix) :
+            out_name_ {boost::filesystem::absolute(prefix + ".out").string()},
+            err_name_ {boost::filesystem::absolute(prefix + ".err").string()} {
+            out_.open(out_name_, std::ios::binary | std::ios::app | std::ios::ate);
+            err_.open(err_name_, std::ios::binary | std::ios::app | std::ios::ate);
+            if (out_.fail() || err_.fail())
+                throw std::system_error(errno, std::generic_category(),
+                                        "can not open output files");
+        }
+
+        Result Output_store::store(const Result& result) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            try {
+                auto stdout_file = append(out_, out_name_, result.stdout(),
+                                          result.stdout_file());
+                auto stderr_file = append(err_, err_name_, result.stderr(),
+                                          result.stderr_file());
+                return Result(result.exit_status(), "", "", stdout_file,
+                              stderr_file, true, result.usage(),
+                              result.is_timed_out());
+            } catch (std::system_error&) {
+                // the output is lost, so are the spill files
+                boost::system::error_code err;
+                for (const auto& spill: {result.stdout_file(),
+                                         result.stderr_file()})
+                    if (!spill.name.empty())
+                        boost::filesystem::remove(spill.name, err);
+                throw;
+            }
+        }
+
+        // errno is not set by all stream failures
+        static std::system_error stream_error(const std::string& msg) {
+            return std::system_error(errno != 0 ? errno : EIO,
+                                     std::generic_category(), msg);
+        }
+
+        Output_file Output_store::append(std::ofstream& file,
+                                         const std::string& name,
+                                         const std::string& output,
+                                         const Output_file& spill) {
+            // a stream that failed for a previous work item is reset, its
+            // partial output is not referenced by any result, the file is
+            // opened for appending, so the next output follows it
+            errno = 0;
+            file.clear();
+            auto offset = file.tellp();
+            if (offset < 0)
+                throw stream_error("can not locate the end of '" + name + "'");
+            Output_file location {name, static_cast<size_t>(offset), 0};
+            if (!(file << output))
+                throw stream_error("can not write '" + name + "'");
+            location.length = output.length();
+            if (!spill.name.empty()) {
+                std::ifstream spill_file(spill.name, std::ios::binary);
+                if (!spill_file)
+                    throw stream_error("can not open spill file '" +
+                                       spill.name + "'");
+                if (spill_file.peek() != std::ifstream::traits_type::eof() &&
+                        !(file << spill_file.rdbuf()))
+                    throw stream_error("can not copy spill file '" +
+                                       spill.name + "' to '" + name + "'");
+                spill_file.close();
+                location.length += spill.length;
+                boost::system::error_code err;
+                boost::filesystem::remove(spill.name, err);
+            }
+            // the server may read the output as soon as it gets the result,
+            // so it has to be complete
+            if (!file.flush() || file.tellp() !=
+                    static_cast<std::streamoff>(location.offset + location.length))
+                throw stream_error("can not write '" + name + "'");
+            return location;
+        }
+
+    }
+}
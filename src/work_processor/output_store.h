@@ -0,0 +1,76 @@
+/*!
+  \file
+  \brief Storage of the output of work items by the client
+ */
+#ifndef OUTPUT_STORE_HDR
+#define OUTPUT_STORE_HDR
+
+#include <fstream>
+#include <mutex>
+#include <string>
+
+#include "result.h"
+
+namespace worker {
+    namespace work_processor {
+
+        /*!
+          \brief Class that appends the output of work items to a pair of
+                 files, one for standard output, one for standard error.
+
+          The output of a work item is written contiguously, so that it
+          can be located by its offset and length.  Several slots can
+          store results concurrently.
+         */
+        class Output_store {
+            public:
+                /*!
+                  \brief Output_store constructor.
+                  \param prefix std::string path prefix of the files, the
+                         extensions .out and .err are appended.
+                  \throw std::system_error if the files can not be opened.
+                 */
+                explicit Output_store(const std::string& prefix);
+
+                Output_store(const Output_store&) = delete;
+                Output_store& operator=(const Output_store&) = delete;
+
+                /*!
+                  \brief appends the output of a result to the files, and
+                         removes its spill files, if any.
+                  \param result Result to store.
+                  \return result without output in memory, but with the
+                          location of the stored output.
+                  \throw std::system_error if the output can not be
+                         written, its spill files are removed.
+                 */
+                Result store(const Result& result);
+
+            private:
+                //! file for standard output and its name
+                std::ofstream out_;
+                std::string out_name_;
+                //! file for standard error and its name
+                std::ofstream err_;
+                std::string err_name_;
+                //! serializes writes by concurrent slots
+                std::mutex mutex_;
+                /*!
+                  \brief appends output to a file.
+                  \param file std::ofstream& file to write to.
+                  \param name std::string name of the file.
+                  \param output std::string output that was kept in memory.
+                  \param spill Output_file spilled output, if any.
+                  \return location of the output in the file.
+                  \throw std::system_error if the output can not be
+                         written completely.
+                 */
+                Output_file append(std::ofstream& file, const std::string& name,
+                                   const std::string& output,
+                                   const Output_file& spill);
+        };
+
+    }
+}
+
+#endif
@@ -1,5 +1,24 @@
+#include <algorithm>
+#include <boost/filesystem.hpp>
 #include <boost/process.hpp>
+#include <boost/process/extend.hpp>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <fcntl.h>
+#include <fstream>
 #include <iostream>
+#include <mutex>
+#include <poll.h>
+#include <spawn.h>
+#include <sstream>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <system_error>
+#include <unistd.h>
+#include <vector>
 
 #include "processor.h"
 
@@ -8,33 +27,766 @@ namespace worker {
 
         namespace bp = boost::process;
 
-        Result process_work(const std::string work_item) {
+        Result process_work(const std::string& work_item) {
             Env env;
             return process_work(work_item, env);
         }
 
-        Result process_work(const std::string work_item, Env& env) {
-            int exit_code {0};
-            std::string output_str;
-            std::string error_str;
-            bp::ipstream ips;
-            bp::ipstream eps;
-            bp::opstream ops;
-            bp::child process(bp::search_path("bash"), "-l", env,
-                    bp::std_out > ips, bp::std_err > eps,
-                    bp::std_in < ops);
-            ops << work_item << "\nexit $?" << std::endl;
-            process.wait();
-            std::string line;
-            while (std::getline(ips, line)) {
-                output_str += line + "\n";
-            }
-            while (std::getline(eps, line)) {
-                error_str += line + "\n";
-            }
-            exit_code = process.exit_code();
-            process.terminate();
-            return Result(exit_code, output_str, error_str);
+        // work items may be processed concurrently by several threads,
+        // the pipes for a child process are created and marked close-on-exec
+        // while holding this lock, so that they don't leak into the child
+        // processes of other threads
+        static std::mutex launch_mutex;
+
+        template<typename Pipe>
+        void set_close_on_exec(Pipe& pipe) {
+            fcntl(pipe.native_source(), F_SETFD, FD_CLOEXEC);
+            fcntl(pipe.native_sink(), F_SETFD, FD_CLOEXEC);
+        }
+
+        /*!
+          \brief output of a stream of a work item, the first part is kept
+                 in memory, the remainder is spilled to a file.
+         */
+        class Output_capture {
+            public:
+                explicit Output_capture(const Output_options& options) :
+                    options_ {options} {};
+                //! a spill file that was not handed over is removed
+                ~Output_capture() {
+                    if (spill_fd_ >= 0)
+                        close(spill_fd_);
+                    if (!spill_file_.empty() && !is_handed_over_) {
+                        boost::system::error_code err;
+                        boost::filesystem::remove(spill_file_, err);
+                    }
+                }
+                Output_capture(const Output_capture&) = delete;
+                Output_capture& operator=(const Output_capture&) = delete;
+                void append(const char* data, size_t size) {
+                    size_t in_memory = std::min(size,
+                            options_.max_size - std::min(options_.max_size,
+                                                         memory_.size()));
+                    memory_.append(data, in_memory);
+                    if (in_memory < size)
+                        spill(data + in_memory, size - in_memory);
+                }
+                std::string memory() { return std::move(memory_); }
+                Output_file spill_file() {
+                    is_handed_over_ = true;
+                    return {spill_file_, 0, nr_spilled_};
+                }
+            private:
+                //! output that can not be written to the spill file is
+                //! an error of the work item, rather than lost silently
+                void spill(const char* data, size_t size) {
+                    if (spill_fd_ < 0) {
+                        auto name = (boost::filesystem::absolute(
+                                    options_.spill_dir) /
+                                "worker_spill_XXXXXX").string();
+                        spill_fd_ = mkostemp(&name[0], O_CLOEXEC);
+                        if (spill_fd_ < 0)
+                            throw std::system_error(errno, std::generic_category(),
+                                                    "can not create spill file");
+                        spill_file_ = name;
+                    }
+                    while (size > 0) {
+                        ssize_t nr_written = write(spill_fd_, data, size);
+                        if (nr_written < 0) {
+                            if (errno == EINTR)
+                                continue;
+                            throw std::system_error(errno, std::generic_category(),
+                                                    "can not write spill file");
+                        }
+                        data += nr_written;
+                        size -= nr_written;
+                        nr_spilled_ += nr_written;
+                    }
+                }
+                const Output_options& options_;
+                std::string memory_;
+                std::string spill_file_;
+                int spill_fd_ {-1};
+                size_t nr_spilled_ {0};
+                bool is_handed_over_ {false};
+        };
+
+        using Clock = std::chrono::steady_clock;
+
+        // time a work item that exceeds its time limit gets to exit after
+        // SIGTERM, before it is killed, and to close its output after that
+        static const std::chrono::seconds kill_grace_period {10};
+        // interval in which a work item that can be cancelled checks
+        // whether it was
+        static const std::chrono::milliseconds cancel_check_interval {100};
+        // maximum interval in which a work item that closed its output is
+        // checked for having exited, while it has a time limit
+        static const std::chrono::milliseconds max_reap_interval {100};
+
+        /*!
+          \brief kills the process group of a work item that exceeds its
+                 time limit, or that is cancelled, first with SIGTERM, then
+                 with SIGKILL.
+         */
+        class Time_limit {
+            public:
+                Time_limit(std::chrono::seconds limit,
+                           const std::atomic<bool>* is_cancelled) :
+                    deadline_ {Clock::now() + limit},
+                    is_limited_ {limit.count() > 0},
+                    is_cancelled_ {is_cancelled} {};
+                //! time out for poll in ms until the next step, -1 if none
+                int poll_timeout() const {
+                    int timeout {-1};
+                    if (is_limited_) {
+                        auto time_left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                deadline_ - Clock::now()).count();
+                        timeout = time_left > 0 ? static_cast<int>(time_left) : 0;
+                    }
+                    if (is_cancelled_ && !was_cancelled_ &&
+                            (timeout < 0 || timeout > cancel_check_interval.count()))
+                        timeout = static_cast<int>(cancel_check_interval.count());
+                    return timeout;
+                }
+                //! signal the process group if the deadline passed, or the
+                //! work item was cancelled, returns false once there is no
+                //! point in waiting for it
+                bool check(pid_t process_group) {
+                    if (is_cancelled_ && !was_cancelled_ && nr_signals_ == 0 &&
+                            is_cancelled_->load()) {
+                        was_cancelled_ = true;
+                        is_limited_ = true;
+                        deadline_ = Clock::now();
+                    }
+                    if (!is_limited_ || Clock::now() < deadline_)
+                        return true;
+                    // the process group may not be known yet
+                    if (process_group <= 0) {
+                        deadline_ += std::chrono::milliseconds(10);
+                        return true;
+                    }
+                    if (nr_signals_ == 2)
+                        return false;
+                    kill(-process_group, nr_signals_ == 0 ? SIGTERM : SIGKILL);
+                    ++nr_signals_;
+                    deadline_ = Clock::now() + kill_grace_period;
+                    return true;
+                }
+                bool is_timed_out() const {
+                    return nr_signals_ > 0 && !was_cancelled_;
+                }
+            private:
+                Clock::time_point deadline_;
+                bool is_limited_;
+                const std::atomic<bool>* is_cancelled_;
+                bool was_cancelled_ {false};
+                int nr_signals_ {0};
+        };
+
+        /*!
+          \brief feeds the script to a child while draining its standard
+                 output and error, so that neither side blocks on a full
+                 pipe, returns when both reach end of file, or when the
+                 child's process group was killed for exceeding its time
+                 limit, and its output was not closed after all.  The
+                 descriptors are closed when it returns.  The time limit
+                 keeps running, so that it applies to reaping the child
+                 as well.
+          \param script std::string script to write
+          \param in_fd int write end of the child's standard input, it is
+                 closed once the script is written
+          \param out_fd int read end of the child's standard output
+          \param err_fd int read end of the child's standard error
+          \param output Output_capture& for the standard output
+          \param error Output_capture& for the standard error
+          \param process_group pid_t process group of the child, which
+                 is its leader
+          \param limit Time_limit& walltime limit of the child, and
+                 whether it was cancelled
+          \throw std::system_error if the output can not be read or
+                 stored, the child's process group is killed, and the
+                 child is reaped, before it is thrown
+         */
+        static void exchange(const std::string& script, int in_fd,
+                             int out_fd, int err_fd, Output_capture& output,
+                             Output_capture& error, pid_t process_group,
+                             Time_limit& limit) {
+            size_t nr_written {0};
+            fcntl(in_fd, F_SETFL, fcntl(in_fd, F_GETFL) | O_NONBLOCK);
+            struct pollfd fds[] = {
+                {out_fd, POLLIN, 0},
+                {err_fd, POLLIN, 0},
+                {in_fd, POLLOUT, 0}
+            };
+            Output_capture* captures[] = {&output, &error};
+            std::vector<char> buffer(64*1024);
+            try {
+                while ((fds[0].fd >= 0 || fds[1].fd >= 0) &&
+                        limit.check(process_group)) {
+                    if (poll(fds, 3, limit.poll_timeout()) < 0) {
+                        if (errno == EINTR)
+                            continue;
+                        throw std::system_error(errno, std::generic_category(),
+                                                "can not poll output of work item");
+                    }
+                    for (int i = 0; i < 2; ++i) {
+                        if (fds[i].fd < 0 || !fds[i].revents)
+                            continue;
+                        ssize_t size = read(fds[i].fd, buffer.data(), buffer.size());
+                        if (size > 0)
+                            captures[i]->append(buffer.data(), size);
+                        else if (size == 0 || errno != EINTR)
+                            fds[i].fd = -1;
+                    }
+                    if (fds[2].fd >= 0 && fds[2].revents) {
+                        ssize_t size = write(fds[2].fd, script.data() + nr_written,
+                                             script.size() - nr_written);
+                        if (size > 0)
+                            nr_written += size;
+                        // the child may exit before it has read the script
+                        if ((size < 0 && errno != EINTR && errno != EAGAIN) ||
+                                nr_written == script.size()) {
+                            close(fds[2].fd);
+                            fds[2].fd = -1;
+                        }
+                    }
+                }
+            } catch (std::system_error&) {
+                if (fds[2].fd >= 0)
+                    close(fds[2].fd);
+                close(out_fd);
+                close(err_fd);
+                kill(-process_group, SIGKILL);
+                while (waitpid(process_group, nullptr, 0) < 0 && errno == EINTR)
+                    ;
+                throw;
+            }
+            if (fds[2].fd >= 0)
+                close(fds[2].fd);
+            close(out_fd);
+            close(err_fd);
+        }
+
+        static std::int64_t to_microseconds(const struct timeval& time) {
+            return static_cast<std::int64_t>(time.tv_sec)*1000000 +
+                   time.tv_usec;
+        }
+
+        /*!
+          \brief waits for a child to exit, and collects its resource
+                 usage, which includes that of the processes it waited for.
+                 A child may close its output and keep running, so while
+                 it has a time limit, or can be cancelled, it is checked
+                 for having exited in growing intervals, and its process
+                 group is killed when the limit is exceeded.
+          \param pid pid_t process ID of the child, which is the leader
+                 of its process group.
+          \param start Clock::time_point when the child was launched.
+          \param limit Time_limit& walltime limit of the child.
+          \param usage Resource_usage& set to the child's resource usage.
+          \return exit status of the child, 128 + the signal number if
+                  it was killed by a signal, as Bash reports it.
+         */
+        static int wait_child(pid_t pid, Clock::time_point start,
+                              Time_limit& limit, Resource_usage& usage) {
+            int status {0};
+            struct rusage rusage {};
+            std::chrono::milliseconds interval {1};
+            for (bool is_limited {true}; ; ) {
+                int timeout = is_limited ? limit.poll_timeout() : -1;
+                pid_t waited = wait4(pid, &status, timeout < 0 ? 0 : WNOHANG,
+                                     &rusage);
+                if (waited < 0 && errno == EINTR)
+                    continue;
+                if (waited != 0)
+                    break;
+                // once it was killed, it is waited for without a limit
+                is_limited = limit.check(pid);
+                if (is_limited)
+                    poll(nullptr, 0, std::min<int>(timeout, interval.count()));
+                interval = std::min(2*interval, max_reap_interval);
+            }
+            usage.walltime = std::chrono::duration_cast<std::chrono::microseconds>(
+                    Clock::now() - start).count();
+            usage.user_time = to_microseconds(rusage.ru_utime);
+            usage.system_time = to_microseconds(rusage.ru_stime);
+            usage.max_rss = rusage.ru_maxrss;
+            usage.read_blocks = rusage.ru_inblock;
+            usage.write_blocks = rusage.ru_oublock;
+            return WIFEXITED(status) ? WEXITSTATUS(status) :
+                                       128 + WTERMSIG(status);
+        }
+
+        /*!
+          \brief reads the CPU time of the children a process waited for
+                 from /proc.
+          \param pid pid_t process ID.
+          \param user_time std::int64_t& set to the user CPU time in
+                 microseconds.
+          \param system_time std::int64_t& set to the system CPU time in
+                 microseconds.
+          \return true if the times could be read.
+         */
+        static bool children_cpu_time(pid_t pid, std::int64_t& user_time,
+                                      std::int64_t& system_time) {
+            std::ifstream stat_file("/proc/" + std::to_string(pid) + "/stat");
+            std::string stat;
+            if (!std::getline(stat_file, stat))
+                return false;
+            // the command name may contain spaces, the fields after it
+            // start with the state, field 3, cutime and cstime are fields
+            // 16 and 17
+            auto pos = stat.rfind(')');
+            if (pos == std::string::npos)
+                return false;
+            std::istringstream fields(stat.substr(pos + 1));
+            std::string field;
+            for (int i = 3; i < 16; ++i)
+                fields >> field;
+            long long user_ticks;
+            long long system_ticks;
+            if (!(fields >> user_ticks >> system_ticks))
+                return false;
+            static const long ticks_per_second {sysconf(_SC_CLK_TCK)};
+            user_time = user_ticks*1000000/ticks_per_second;
+            system_time = system_ticks*1000000/ticks_per_second;
+            return true;
+        }
+
+        Result process_work(const std::string& work_item, Env& env) {
+            return process_work(work_item, env, Output_options());
+        }
+
+        Result process_work(const std::string& work_item, Env& env,
+                            const Output_options& output_options) {
+            return process_work(work_item, env, output_options,
+                                Shell_options());
+        }
+
+        static std::vector<std::string> shell_args(bool is_login) {
+            if (is_login)
+                return {"-l"};
+            return {};
+        }
+
+        /*!
+          \brief boost::process initializer that starts the child in a
+                 process group of its own.
+         */
+        struct new_process_group : bp::extend::handler {
+            template<typename Executor>
+            void on_exec_setup(Executor&) const {
+                setpgid(0, 0);
+            }
+        };
+
+        Result process_work(const std::string& work_item, Env& env,
+                            const Output_options& output_options,
+                            const Shell_options& shell_options,
+                            std::chrono::seconds time_limit,
+                            const std::atomic<bool>* is_cancelled) {
+            std::unique_lock<std::mutex> launch_lock(launch_mutex);
+            bp::pipe out_pipe;
+            bp::pipe err_pipe;
+            bp::pipe in_pipe;
+            set_close_on_exec(out_pipe);
+            set_close_on_exec(err_pipe);
+            set_close_on_exec(in_pipe);
+            auto start = Clock::now();
+            bp::child process(bp::search_path("bash"),
+                    bp::args(shell_args(shell_options.is_login)), env,
+                    bp::std_out > out_pipe, bp::std_err > err_pipe,
+                    bp::std_in < in_pipe, new_process_group());
+            launch_lock.unlock();
+            // the child's ends of the pipes are closed with the pipes,
+            // the parent's ends by exchange
+            int in_fd = in_pipe.native_sink();
+            in_pipe.assign_sink(-1);
+            int out_fd = out_pipe.native_source();
+            out_pipe.assign_source(-1);
+            int err_fd = err_pipe.native_source();
+            err_pipe.assign_source(-1);
+            Output_capture output(output_options);
+            Output_capture error(output_options);
+            Time_limit limit(time_limit, is_cancelled);
+            try {
+                exchange(work_item + "\nexit $?\n", in_fd, out_fd, err_fd,
+                         output, error, process.id(), limit);
+            } catch (std::system_error&) {
+                // exchange reaped the child
+                process.detach();
+                throw;
+            }
+            // the child is reaped here rather than by boost::process, so
+            // that its resource usage is known
+            Resource_usage usage;
+            int exit_status = wait_child(process.id(), start, limit, usage);
+            process.detach();
+            return Result(exit_status, output.memory(), error.memory(),
+                          output.spill_file(), error.spill_file(), false,
+                          usage, limit.is_timed_out());
+        }
+
+        // prefix of the lines on which a shell reports exit statuses, its
+        // profile may write to its standard output as well
+        static const std::string status_marker {"__worker_status__ "};
+        // prefix of the line on which the subshell of a work item reports
+        // its process ID, which is also its process group ID
+        static const std::string pid_marker {"__worker_pid__ "};
+        // exit status reported when the shell dies while running a work
+        // item
+        static const int shell_died_status {255};
+
+        static bool write_all(int fd, const std::string& data) {
+            size_t nr_written {0};
+            while (nr_written < data.size()) {
+                ssize_t size = write(fd, data.data() + nr_written,
+                                     data.size() - nr_written);
+                if (size < 0) {
+                    if (errno == EINTR)
+                        continue;
+                    return false;
+                }
+                nr_written += size;
+            }
+            return true;
+        }
+
+        Shell::Shell(const Env& env, const Output_options& output_options,
+                     bool is_login) :
+            env_ {env}, output_options_ {output_options},
+            is_login_ {is_login} {
+            auto templ = (boost::filesystem::temp_directory_path() /
+                          "worker_shell_XXXXXX").string();
+            if (mkdtemp(&templ[0]) == nullptr)
+                throw std::system_error(errno, std::generic_category(),
+                                        "can not create shell directory");
+            dir_ = templ;
+            // the read ends are opened first, without blocking, so that
+            // opening the write ends doesn't block either
+            for (auto [name, fds]: {std::make_pair("out", out_fds_),
+                                    std::make_pair("err", err_fds_)}) {
+                auto path = dir_ + "/" + name;
+                if (mkfifo(path.c_str(), 0600) != 0 ||
+                        (fds[0] = open(path.c_str(),
+                                       O_RDONLY | O_NONBLOCK | O_CLOEXEC)) < 0 ||
+                        (fds[1] = open(path.c_str(),
+                                       O_WRONLY | O_CLOEXEC)) < 0) {
+                    int err = errno;
+                    remove_pipes();
+                    throw std::system_error(err, std::generic_category(),
+                                            "can not create named pipe");
+                }
+            }
+            try {
+                start();
+            } catch (std::system_error&) {
+                stop();
+                remove_pipes();
+                throw;
+            }
+        }
+
+        Shell::~Shell() {
+            stop();
+            remove_pipes();
+        }
+
+        void Shell::start() {
+            std::unique_lock<std::mutex> launch_lock(launch_mutex);
+            bp::pipe command_pipe;
+            bp::pipe status_pipe;
+            set_close_on_exec(command_pipe);
+            set_close_on_exec(status_pipe);
+            process_ = std::make_unique<bp::child>(bp::search_path("bash"),
+                    bp::args(shell_args(is_login_)), env_,
+                    bp::std_in < command_pipe, bp::std_out > status_pipe,
+                    bp::std_err > bp::null);
+            launch_lock.unlock();
+            // the ends used by the shell are closed with the pipes
+            command_fd_ = command_pipe.native_sink();
+            command_pipe.assign_sink(-1);
+            status_fd_ = status_pipe.native_source();
+            status_pipe.assign_source(-1);
+            status_buffer_.clear();
+            // with job control, the subshell of each work item is started
+            // in a process group of its own, so that it can be killed as
+            // a whole
+            if (!write_all(command_fd_, "set -m\n")) {
+                int err = errno;
+                stop();
+                throw std::system_error(err, std::generic_category(),
+                                        "can not set up shell");
+            }
+        }
+
+        void Shell::stop() {
+            // the shell exits when it reads an end of file
+            if (command_fd_ >= 0)
+                close(command_fd_);
+            command_fd_ = -1;
+            if (status_fd_ >= 0)
+                close(status_fd_);
+            status_fd_ = -1;
+            if (process_) {
+                std::error_code err;
+                process_->wait(err);
+                process_.reset();
+            }
+        }
+
+        void Shell::remove_pipes() {
+            for (int* fds: {out_fds_, err_fds_})
+                for (int i = 0; i < 2; ++i) {
+                    if (fds[i] >= 0)
+                        close(fds[i]);
+                    fds[i] = -1;
+                }
+            boost::system::error_code err;
+            boost::filesystem::remove_all(dir_, err);
+        }
+
+        Result Shell::run(const std::string& work_item, size_t work_id,
+                          std::chrono::seconds time_limit,
+                          const std::atomic<bool>* is_cancelled) {
+            // the shell may have died since the previous work item
+            if (process_ && !process_->running())
+                stop();
+            if (!process_)
+                start();
+            auto script_name = dir_ + "/script";
+            {
+                std::ofstream script(script_name, std::ios::trunc);
+                script << work_item << "\n";
+            }
+            // the exit status is written even if the subshell's output
+            // can not be opened, the subshell reports its process ID
+            // through descriptor 3 before that is redirected
+            std::string command {
+                "( echo \"" + pid_marker + "$BASHPID\" >&3; exec 3>&-; " +
+                "export WORKER_ITEM_ID=" + std::to_string(work_id) +
+                "; . '" + script_name + "' ) 3>&1 < /dev/null > '" + dir_ +
+                "/out' 2> '" + dir_ + "/err'; echo \"" + status_marker +
+                "$?\"\n"
+            };
+            // the shell reaps the subshell, so its CPU time is the
+            // increase of the CPU time of the shell's children, its memory
+            // and I/O are not known
+            Resource_usage usage;
+            std::int64_t user_time_before {0};
+            std::int64_t system_time_before {0};
+            bool has_cpu_time = children_cpu_time(process_->id(),
+                                                  user_time_before,
+                                                  system_time_before);
+            auto start = Clock::now();
+            Output_capture output(output_options_);
+            Output_capture error(output_options_);
+            int exit_status {shell_died_status};
+            pid_t process_group {0};
+            Time_limit limit(time_limit, is_cancelled);
+            bool is_done {!write_all(command_fd_, command)};
+            struct pollfd fds[] = {
+                {out_fds_[0], POLLIN, 0},
+                {err_fds_[0], POLLIN, 0},
+                {status_fd_, POLLIN, 0}
+            };
+            Output_capture* captures[] = {&output, &error};
+            std::vector<char> buffer(64*1024);
+            // once the exit status is reported, the subshell wrote all its
+            // output, so the named pipes are drained without waiting
+            try {
+                for (bool is_drained {false}; !is_drained; ) {
+                    if (!is_done && !limit.check(process_group)) {
+                        // even SIGKILL didn't make the shell report the exit
+                        // status, it is started anew
+                        kill(process_->id(), SIGKILL);
+                        is_done = true;
+                        stop();
+                        continue;
+                    }
+                    if (!is_done && poll(fds, 3, limit.poll_timeout()) < 0) {
+                        if (errno == EINTR)
+                            continue;
+                        throw std::system_error(errno, std::generic_category(),
+                                                "can not poll output of work item");
+                    }
+                    is_drained = is_done;
+                    for (int i = 0; i < 2; ++i) {
+                        if (!is_done && !fds[i].revents)
+                            continue;
+                        ssize_t size;
+                        while ((size = read(fds[i].fd, buffer.data(),
+                                            buffer.size())) > 0)
+                            captures[i]->append(buffer.data(), size);
+                    }
+                    if (!is_done && fds[2].revents) {
+                        ssize_t size = read(status_fd_, buffer.data(),
+                                            buffer.size());
+                        if (size > 0) {
+                            status_buffer_.append(buffer.data(), size);
+                        } else if (size == 0 || errno != EINTR) {
+                            is_done = true;
+                            continue;
+                        }
+                        for (size_t pos; !is_done &&
+                                (pos = status_buffer_.find('\n')) != std::string::npos; ) {
+                            std::string line = status_buffer_.substr(0, pos);
+                            status_buffer_.erase(0, pos + 1);
+                            if (line.compare(0, pid_marker.length(), pid_marker) == 0) {
+                                process_group = std::atoi(line.c_str() +
+                                                          pid_marker.length());
+                                continue;
+                            }
+                            auto marker_pos = line.find(status_marker);
+                            if (marker_pos == std::string::npos)
+                                continue;
+                            exit_status = std::atoi(line.c_str() + marker_pos +
+                                                    status_marker.length());
+                            is_done = true;
+                        }
+                        // the next iteration drains the named pipes
+                        if (is_done)
+                            continue;
+                    }
+                }
+            } catch (std::system_error&) {
+                // the shell is in an unknown state, e.g., the subshell may
+                // be blocked on output that is not read, both are killed,
+                // the output they left is discarded, and the shell is
+                // started anew for the next work item
+                if (process_group > 0)
+                    kill(-process_group, SIGKILL);
+                if (process_)
+                    kill(process_->id(), SIGKILL);
+                stop();
+                for (int fd: {out_fds_[0], err_fds_[0]})
+                    while (read(fd, buffer.data(), buffer.size()) > 0)
+                        ;
+                throw;
+            }
+            usage.walltime = std::chrono::duration_cast<std::chrono::microseconds>(
+                    Clock::now() - start).count();
+            if (has_cpu_time && process_ && children_cpu_time(process_->id(),
+                                                  usage.user_time,
+                                                  usage.system_time)) {
+                usage.user_time -= user_time_before;
+                usage.system_time -= system_time_before;
+            }
+            if (exit_status == shell_died_status &&
+                    (!process_ || !process_->running())) {
+                std::string msg {"worker: shell exited while running the work item\n"};
+                error.append(msg.data(), msg.size());
+                stop();
+            }
+            return Result(exit_status, output.memory(), error.memory(),
+                          output.spill_file(), error.spill_file(), false,
+                          usage, limit.is_timed_out());
+        }
+
+        Launcher::Launcher(const Env& env,
+                           const Output_options& output_options,
+                           bool is_login) :
+            output_options_ {output_options} {
+            bash_path_ = bp::search_path("bash").string();
+            if (bash_path_.empty())
+                throw std::system_error(ENOENT, std::generic_category(),
+                                        "can not find bash");
+            args_.push_back("bash");
+            for (auto& arg: shell_args(is_login))
+                args_.push_back(arg);
+            for (auto& arg: args_)
+                argv_.push_back(arg.data());
+            argv_.push_back(nullptr);
+            for (const auto& entry: env)
+                if (entry.get_name() != "WORKER_ITEM_ID")
+                    env_entries_.push_back(entry.get_name() + "=" +
+                                           entry.to_string());
+            item_id_index_ = env_entries_.size();
+            env_entries_.push_back("WORKER_ITEM_ID=");
+            for (auto& entry: env_entries_)
+                envp_.push_back(entry.data());
+            envp_.push_back(nullptr);
+        }
+
+        Result Launcher::run(const std::string& work_item, size_t work_id,
+                             std::chrono::seconds time_limit,
+                             const std::atomic<bool>* is_cancelled) {
+            env_entries_[item_id_index_] = "WORKER_ITEM_ID=" +
+                                           std::to_string(work_id);
+            envp_[item_id_index_] = env_entries_[item_id_index_].data();
+            int in_fds[2];
+            int out_fds[2];
+            int err_fds[2];
+            int* all_fds[] = {in_fds, out_fds, err_fds};
+            for (int i = 0; i < 3; ++i)
+                if (pipe2(all_fds[i], O_CLOEXEC) != 0) {
+                    int err = errno;
+                    for (int j = 0; j < i; ++j) {
+                        close(all_fds[j][0]);
+                        close(all_fds[j][1]);
+                    }
+                    throw std::system_error(err, std::generic_category(),
+                                            "can not create pipes");
+                }
+            // dup2 clears close-on-exec on the standard streams only, the
+            // shell inherits no other descriptors of the pipes; it gets
+            // the default SIGPIPE disposition, which the client ignores,
+            // and a process group of its own, so that it can be killed
+            // as a whole
+            // the first call that fails, if any, skips the ones that
+            // follow, the shell is not launched
+            posix_spawn_file_actions_t actions;
+            posix_spawnattr_t attr;
+            int status = posix_spawn_file_actions_init(&actions);
+            bool has_actions {status == 0};
+            if (status == 0)
+                status = posix_spawnattr_init(&attr);
+            bool has_attr {has_actions && status == 0};
+            for (auto [fd, target]: {std::make_pair(in_fds[0], 0),
+                                     std::make_pair(out_fds[1], 1),
+                                     std::make_pair(err_fds[1], 2)})
+                if (status == 0)
+                    status = posix_spawn_file_actions_adddup2(&actions, fd,
+                                                              target);
+            sigset_t default_signals;
+            sigemptyset(&default_signals);
+            sigaddset(&default_signals, SIGPIPE);
+            if (status == 0)
+                status = posix_spawnattr_setsigdefault(&attr, &default_signals);
+            if (status == 0)
+                status = posix_spawnattr_setpgroup(&attr, 0);
+            if (status == 0)
+                status = posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF |
+                                                         POSIX_SPAWN_SETPGROUP);
+            pid_t pid {0};
+            auto start = Clock::now();
+            if (status == 0)
+                status = posix_spawn(&pid, bash_path_.c_str(), &actions,
+                                     &attr, argv_.data(), envp_.data());
+            if (has_actions)
+                posix_spawn_file_actions_destroy(&actions);
+            if (has_attr)
+                posix_spawnattr_destroy(&attr);
+            close(in_fds[0]);
+            close(out_fds[1]);
+            close(err_fds[1]);
+            if (status != 0) {
+                close(in_fds[1]);
+                close(out_fds[0]);
+                close(err_fds[0]);
+                throw std::system_error(status, std::generic_category(),
+                                        "can not launch bash");
+            }
+            Output_capture output(output_options_);
+            Output_capture error(output_options_);
+            Time_limit limit(time_limit, is_cancelled);
+            exchange(work_item + "\nexit $?\n", in_fds[1], out_fds[0],
+                     err_fds[0], output, error, pid, limit);
+            Resource_usage usage;
+            int exit_status = wait_child(pid, start, limit, usage);
+            return Result(exit_status, output.memory(), error.memory(),
+                          output.spill_file(), error.spill_file(), false,
+                          usage, limit.is_timed_out());
         }
 
     }
@@ -2,7 +2,15 @@
 #define PROCESSOR_HDR
 
 #include <boost/process/detail/traits/wchar_t.hpp>
+#include <boost/process/child.hpp>
 #include <boost/process/env.hpp>
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
 #include "result.h"
 
 namespace worker {
@@ -15,7 +23,7 @@ namespace worker {
           \return result object containing the exit status, the standard
                   output and error generated by executing the Bash scriot.
          */
-        Result process_work(const std::string work_item);
+        Result process_work(const std::string& work_item);
 
         using Env = boost::process::environment;
 
@@ -27,7 +35,225 @@ namespace worker {
           \return result object containing the exit status, the standard
                   output and error generated by executing the Bash scriot.
          */
-        Result process_work(const std::string work_item, Env& env);
+        Result process_work(const std::string& work_item, Env& env);
+
+        /*!
+          \brief options that bound the memory used to capture the output
+                 of a work item.
+         */
+        struct Output_options {
+            //! maximum number of bytes of standard output, and of standard
+            //! error, that is kept in memory
+            size_t max_size {std::numeric_limits<size_t>::max()};
+            //! directory to spill output beyond max_size to, it should be
+            //! accessible to the server
+            std::string spill_dir {"."};
+            //! when not empty, the client stores the output of work items
+            //! in files with this prefix, and the server only records
+            //! their location
+            std::string store_prefix;
+        };
+
+        /*!
+          \brief executes the argument string as Bash script using
+                 environment, standard output and standard error are
+                 read while the script runs, output beyond the maximum
+                 size is spilled to a file.
+          \param work_item std::string representing a Bash script to be
+                 executed
+          \param env boost::process::env environment variables to use
+          \param output_options Output_options bounds on the output kept
+                 in memory
+          \return result object containing the exit status, the standard
+                  output and error generated by executing the Bash script,
+                  and the names of the spill files, if any.
+         */
+        Result process_work(const std::string& work_item, Env& env,
+                            const Output_options& output_options);
+
+        /*!
+          \brief options for the shells that run work items.
+         */
+        struct Shell_options {
+            //! run work items in a login shell, which sources the
+            //! profiles
+            bool is_login {true};
+            //! run all work items of a slot in a single shell, rather
+            //! than in a shell of their own
+            bool is_persistent {false};
+        };
+
+        /*!
+          \brief executes the argument string as Bash script using
+                 environment in a shell of its own, as above, but
+                 optionally in a shell that is not a login shell.
+          \param work_item std::string representing a Bash script to be
+                 executed
+          \param env boost::process::env environment variables to use
+          \param output_options Output_options bounds on the output kept
+                 in memory
+          \param shell_options Shell_options, whether the shell is a
+                 login shell
+          \param time_limit std::chrono::seconds walltime limit, when it
+                 is exceeded, the shell's process group is sent SIGTERM,
+                 and SIGKILL if it doesn't exit soon after, 0 for none
+          \param is_cancelled const std::atomic<bool>* flag that is set
+                 when the work item is cancelled, its process group is
+                 then killed as for a time limit, nullptr if it can not
+                 be cancelled
+          \return result object as above.
+         */
+        Result process_work(const std::string& work_item, Env& env,
+                            const Output_options& output_options,
+                            const Shell_options& shell_options,
+                            std::chrono::seconds time_limit = std::chrono::seconds(0),
+                            const std::atomic<bool>* is_cancelled = nullptr);
+
+        /*!
+          \brief Bash shell that executes work items one after the other.
+
+          The shell is started once, so a login shell sources the profiles
+          once, rather than for each work item.  Each work item runs in a
+          subshell, so that changes to its environment or working
+          directory, or an exit, don't affect the next.  Its standard
+          input is /dev/null, its standard output and error are sent
+          through named pipes in a private directory, and the shell
+          reports its exit status on its own standard output.  The shell
+          runs with job control, so each subshell has a process group of
+          its own, that is killed when it exceeds its time limit.  A shell
+          that dies is started again for the next work item.  Output of
+          background processes that outlive their work item may end up
+          in the output of the next.
+         */
+        class Shell {
+            public:
+                /*!
+                  \brief Shell constructor, starts the shell.
+                  \param env Env environment of the shell.
+                  \param output_options Output_options bounds on the
+                         output of a work item kept in memory.
+                  \param is_login bool true for a login shell.
+                  \throw std::system_error if the named pipes, or the
+                         shell can not be created.
+                 */
+                Shell(const Env& env, const Output_options& output_options,
+                      bool is_login);
+
+                /*!
+                  \brief Shell destructor, stops the shell, and removes
+                         its directory.
+                 */
+                ~Shell();
+
+                Shell(const Shell&) = delete;
+                Shell& operator=(const Shell&) = delete;
+
+                /*!
+                  \brief executes the argument string as Bash script in a
+                         subshell.
+                  \param work_item std::string representing a Bash script
+                         to be executed
+                  \param work_id size_t ID of the work item, the
+                         subshell's WORKER_ITEM_ID.
+                  \param time_limit std::chrono::seconds walltime limit
+                         of the work item, 0 for none.
+                  \param is_cancelled const std::atomic<bool>* flag that
+                         is set when the work item is cancelled, nullptr
+                         if it can not be cancelled.
+                  \return result object containing the exit status, the
+                          standard output and error, and the names of the
+                          spill files, if any.
+                 */
+                Result run(const std::string& work_item, size_t work_id,
+                           std::chrono::seconds time_limit = std::chrono::seconds(0),
+                           const std::atomic<bool>* is_cancelled = nullptr);
+
+            private:
+                Env env_;
+                const Output_options& output_options_;
+                bool is_login_;
+                //! private directory for the named pipes and the script
+                std::string dir_;
+                //! read and write ends of the named pipes for standard
+                //! output and error, the write ends are kept open, so
+                //! that the read ends never see an end of file
+                int out_fds_[2] {-1, -1};
+                int err_fds_[2] {-1, -1};
+                //! the shell reads commands from this pipe
+                int command_fd_ {-1};
+                //! the shell reports exit statuses on this pipe
+                int status_fd_ {-1};
+                std::string status_buffer_;
+                std::unique_ptr<boost::process::child> process_;
+                //! start the shell
+                void start();
+                //! stop the shell, and wait for it to exit
+                void stop();
+                //! close the named pipes, and remove the directory
+                void remove_pipes();
+        };
+
+        /*!
+          \brief Launches a Bash shell per work item with posix_spawn.
+
+          The path of Bash is resolved, and the environment block is built
+          once, only WORKER_ITEM_ID is replaced for each work item.  The
+          pipes to the shell are created close-on-exec, so, unlike
+          process_work, launches in concurrent slots don't have to be
+          serialized to keep the pipes from leaking into other work items.
+          The work item's script is fed to the shell's standard input,
+          its standard output and error are read while it runs.
+         */
+        class Launcher {
+            public:
+                /*!
+                  \brief Launcher constructor.
+                  \param env Env environment of the shells.
+                  \param output_options Output_options bounds on the
+                         output of a work item kept in memory.
+                  \param is_login bool true for a login shell.
+                  \throw std::system_error if Bash can not be found.
+                 */
+                Launcher(const Env& env, const Output_options& output_options,
+                         bool is_login);
+
+                Launcher(const Launcher&) = delete;
+                Launcher& operator=(const Launcher&) = delete;
+
+                /*!
+                  \brief executes the argument string as Bash script.
+                  \param work_item std::string representing a Bash script
+                         to be executed
+                  \param work_id size_t ID of the work item, the shell's
+                         WORKER_ITEM_ID.
+                  \param time_limit std::chrono::seconds walltime limit
+                         of the work item, 0 for none.
+                  \param is_cancelled const std::atomic<bool>* flag that
+                         is set when the work item is cancelled, nullptr
+                         if it can not be cancelled.
+                  \return result object containing the exit status, the
+                          standard output and error, and the names of the
+                          spill files, if any.
+                  \throw std::system_error if the shell can not be
+                         launched.
+                 */
+                Result run(const std::string& work_item, size_t work_id,
+                           std::chrono::seconds time_limit = std::chrono::seconds(0),
+                           const std::atomic<bool>* is_cancelled = nullptr);
+
+            private:
+                const Output_options& output_options_;
+                std::string bash_path_;
+                //! arguments of the shell, null terminated
+                std::vector<char*> argv_;
+                std::vector<std::string> args_;
+                //! environment variables as "name=value", and the null
+                //! terminated array of pointers to them passed to the shell
+                std::vector<std::string> env_entries_;
+                std::vector<char*> envp_;
+                //! index of WORKER_ITEM_ID in the environment
+                size_t item_id_index_;
+        };
 
     }
 }
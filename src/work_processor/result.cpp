@@ -1,6 +1,7 @@
 #include <sstream>
 
 #include "result.h"
+#include "../wire.h"
 
 namespace worker {
     namespace work_processor {
@@ -39,5 +40,82 @@ namespace worker {
             return str.str();
         }
 
+        // size of the fixed part of the binary representation
+        static const size_t encoded_header_size {4 + 1 + 8*8 + 6*8};
+        // bits of the flags of the binary representation
+        static const std::uint64_t stored_flag {1};
+        static const std::uint64_t timed_out_flag {2};
+
+        std::string Result::encode() const {
+            std::string str;
+            str.reserve(encoded_header_size + _stdout.length() +
+                        _stderr.length() + _stdout_file.name.length() +
+                        _stderr_file.name.length());
+            wire::put_uint(str, static_cast<std::uint32_t>(_exit_status), 4);
+            wire::put_uint(str, (_is_stored ? stored_flag : 0) |
+                                (_is_timed_out ? timed_out_flag : 0), 1);
+            wire::put_uint(str, _stdout.length(), 8);
+            wire::put_uint(str, _stderr.length(), 8);
+            for (const auto* file: {&_stdout_file, &_stderr_file}) {
+                wire::put_uint(str, file->name.length(), 8);
+                wire::put_uint(str, file->offset, 8);
+                wire::put_uint(str, file->length, 8);
+            }
+            for (auto value: {_usage.walltime, _usage.user_time,
+                              _usage.system_time, _usage.max_rss,
+                              _usage.read_blocks, _usage.write_blocks})
+                wire::put_uint(str, static_cast<std::uint64_t>(value), 8);
+            str.append(_stdout);
+            str.append(_stderr);
+            str.append(_stdout_file.name);
+            str.append(_stderr_file.name);
+            return str;
+        }
+
+        Result Result::decode(std::string_view str) {
+            if (str.length() < encoded_header_size)
+                throw result_parse_exception("can't read result header");
+            const char* data = str.data();
+            int exit_status = static_cast<std::int32_t>(
+                    static_cast<std::uint32_t>(wire::get_uint(data, 4)));
+            auto flags = wire::get_uint(data + 4, 1);
+            bool is_stored = (flags & stored_flag) != 0;
+            bool is_timed_out = (flags & timed_out_flag) != 0;
+            Output_file files[2];
+            size_t sizes[4] {
+                wire::get_uint(data + 5, 8), wire::get_uint(data + 13, 8)
+            };
+            for (int i = 0; i < 2; ++i) {
+                const char* file_data = data + 21 + 24*i;
+                sizes[2 + i] = wire::get_uint(file_data, 8);
+                files[i].offset = wire::get_uint(file_data + 8, 8);
+                files[i].length = wire::get_uint(file_data + 16, 8);
+            }
+            Resource_usage usage;
+            const char* usage_data = data + 69;
+            for (auto* value: {&usage.walltime, &usage.user_time,
+                               &usage.system_time, &usage.max_rss,
+                               &usage.read_blocks, &usage.write_blocks}) {
+                *value = static_cast<std::int64_t>(wire::get_uint(usage_data, 8));
+                usage_data += 8;
+            }
+            std::string fields[4];
+            size_t pos {encoded_header_size};
+            for (int i = 0; i < 4; ++i) {
+                if (str.length() - pos < sizes[i])
+                    throw result_parse_exception("result size mismatch");
+                fields[i] = std::string(str.substr(pos, sizes[i]));
+                pos += sizes[i];
+            }
+            if (pos != str.length())
+                throw result_parse_exception("result size mismatch");
+            files[0].name = std::move(fields[2]);
+            files[1].name = std::move(fields[3]);
+            return Result(exit_status, std::move(fields[0]),
+                          std::move(fields[1]), std::move(files[0]),
+                          std::move(files[1]), is_stored, usage,
+                          is_timed_out);
+        }
+
     }
 }
@@ -5,19 +5,58 @@
 #ifndef PROCESSOR_RESULT_HDR
 #define PROCESSOR_RESULT_HDR
 
+#include <cstdint>
 #include <iostream>
+#include <string>
+#include <string_view>
 
 #include "../worker_exception.h"
 
 namespace worker {
     namespace work_processor {
 
+        /*!
+          \brief location of output of a work item in a file.
+         */
+        struct Output_file {
+            //! name of the file, empty if there is no such output
+            std::string name;
+            //! position of the output in the file
+            size_t offset {0};
+            //! number of bytes of output
+            size_t length {0};
+        };
+
+        /*!
+          \brief resources used by a work item, i.e., by its shell and the
+                 processes the shell waited for.
+         */
+        struct Resource_usage {
+            //! wall time from launch to exit in microseconds
+            std::int64_t walltime {0};
+            //! user CPU time in microseconds
+            std::int64_t user_time {0};
+            //! system CPU time in microseconds
+            std::int64_t system_time {0};
+            //! maximum resident set size of any of the processes in KB,
+            //! 0 if unknown
+            std::int64_t max_rss {0};
+            //! number of blocks read from, and written to the filesystem
+            std::int64_t read_blocks {0};
+            std::int64_t write_blocks {0};
+        };
+
         /*!
           \brief Class to represent the result of running a work item.
 
           Objects of this class have the exit code, the standard output,
           and the standard error generated by running the work item as
-          a Bash script.
+          a Bash script.  When the output is too large to keep in memory,
+          the remainder is stored in a spill file, the result only has
+          its location.  When the client stores the output itself, the
+          result has no output in memory, only the location of the
+          stored output.  It also has the resources used by the work
+          item.
          */
         class Result {
             public:
@@ -25,15 +64,48 @@ namespace worker {
                   \brief Result constructor.
                   \param exit_stats int representing the exit status
                          of the process.
-                  \param stdout std::string& representing the standard
-                         output of the process.
-                  \param stderr std::string& representing the standard
-                         error of the process.
+                  \param stdout std::string representing the standard
+                         output of the process, moved into the result.
+                  \param stderr std::string representing the standard
+                         error of the process, moved into the result.
+                 */
+                Result(const int exit_status, std::string stdout,
+                        std::string stderr) :
+                    _exit_status {exit_status}, _stdout {std::move(stdout)},
+                                 _stderr {std::move(stderr)} {};
+
+                /*!
+                  \brief Result constructor for output that is (partially)
+                         stored in files.
+                  \param exit_stats int representing the exit status
+                         of the process.
+                  \param stdout std::string representing the first part
+                         of the standard output of the process.
+                  \param stderr std::string representing the first part
+                         of the standard error of the process.
+                  \param stdout_file Output_file location of the
+                         remainder of the standard output.
+                  \param stderr_file Output_file location of the
+                         remainder of the standard error.
+                  \param is_stored bool true if the files are the final
+                         location of the output, false if they are spill
+                         files to be copied by the server.
+                  \param usage Resource_usage resources used by the work
+                         item.
+                  \param is_timed_out bool true if the work item was
+                         killed since it exceeded its time limit.
                  */
-                Result(const int exit_status, const std::string& stdout,
-                        const std::string& stderr) :
-                    _exit_status {exit_status}, _stdout {stdout},
-                                 _stderr {stderr} {};
+                Result(const int exit_status, std::string stdout,
+                        std::string stderr, Output_file stdout_file,
+                        Output_file stderr_file, bool is_stored,
+                        const Resource_usage& usage = Resource_usage(),
+                        bool is_timed_out = false) :
+                    _exit_status {exit_status}, _stdout {std::move(stdout)},
+                                 _stderr {std::move(stderr)},
+                                 _stdout_file {std::move(stdout_file)},
+                                 _stderr_file {std::move(stderr_file)},
+                                 _is_stored {is_stored}, _usage {usage},
+                                 _is_timed_out {is_timed_out} {};
 
                 /*!
                   \brief Result constructor.
@@ -54,20 +126,83 @@ namespace worker {
                   \return string contianing the starndard output generated
                           by the Bash script that was run.
                  */
-                std::string stdout() const { return _stdout; };
+                const std::string& stdout() const { return _stdout; };
 
                 /*!
                   \brief returns the standard error of the result.
                   \return string contianing the starndard error generated
                           by the Bash script that was run.
                  */
-                std::string stderr() const { return _stderr; };
+                const std::string& stderr() const { return _stderr; };
+
+                /*!
+                  \brief returns the location of the remainder of the
+                         standard output.
+                  \return file location, the name is empty if all output
+                          is in memory.
+                 */
+                const Output_file& stdout_file() const { return _stdout_file; };
+
+                /*!
+                  \brief returns the location of the remainder of the
+                         standard error.
+                  \return file location, the name is empty if all output
+                          is in memory.
+                 */
+                const Output_file& stderr_file() const { return _stderr_file; };
+
+                /*!
+                  \brief returns whether the output has been stored by the
+                         client, rather than spilled.
+                  \return true if the output files are its final location.
+                 */
+                bool is_stored() const { return _is_stored; };
+
+                /*!
+                  \brief returns the resources used by the work item.
+                  \return resource usage, all zero if unknown.
+                 */
+                const Resource_usage& usage() const { return _usage; };
+
+                /*!
+                  \brief returns whether the work item was killed since
+                         it exceeded its time limit.
+                  \return true if the work item timed out, its exit
+                          status is that of the killed shell.
+                 */
+                bool is_timed_out() const { return _is_timed_out; };
 
                 /*!
                   \brief returns a string representation of the result.
                   \return string representation of the result.
                  */
                 std::string to_string() const;
+
+                /*!
+                  \brief returns the binary representation of the result
+                         that is sent to the server, i.e., the exit status
+                         (4 bytes), flags (1 byte): bit 0 is set when the
+                         output is stored, bit 1 when the work item timed
+                         out, the sizes of standard output, standard
+                         error, the names of their files, and the offsets
+                         and lengths in those files, and the fields of the
+                         resource usage (8 bytes each), all little endian,
+                         followed by standard output, standard error and
+                         the file names.
+                  \return binary representation of the result.
+                 */
+                std::string encode() const;
+
+                /*!
+                  \brief creates a result from its binary representation.
+                  \param str std::string_view binary representation of a
+                         result, as created by encode.
+                  \return result.
+                  \throw result_parse_exception if the representation is
+                         malformed.
+                 */
+                static Result decode(std::string_view str);
+
                 /*!
                   \brief overloaded put-to operator writing a string
                          representation to an output stream.
@@ -82,6 +217,11 @@ namespace worker {
                 int _exit_status;
                 std::string _stdout;
                 std::string _stderr;
+                Output_file _stdout_file;
+                Output_file _stderr_file;
+                bool _is_stored {false};
+                Resource_usage _usage;
+                bool _is_timed_out {false};
         };
 
         /*!
@@ -0,0 +1,212 @@
+#include <boost/log/trivial.hpp>
+#include <algorithm>
+#include <csignal>
+#include <fcntl.h>
+#include <system_error>
+#include <unistd.h>
+
+#include "directives.h"
+#include "slot_pool.h"
+
+namespace worker {
+    namespace work_processor {
+
+        // exit status of a work item that could not be run, as that of a
+        // work item whose shell died
+        static const int run_failed_status {255};
+
+        Slot_pool::Slot_pool(int nr_slots, const Env& env,
+                             const Output_options& output_options,
+                             const Shell_options& shell_options,
+                             std::chrono::seconds time_limit) :
+            nr_slots_ {nr_slots}, output_options_ {output_options},
+            shell_options_ {shell_options}, time_limit_ {time_limit},
+            running_(nr_slots), is_cancelled_ {new std::atomic<bool>[nr_slots]},
+            nr_busy_ {0}, is_done_ {false} {
+            if (pipe(notify_fds_) != 0)
+                throw std::system_error(errno, std::generic_category(),
+                                        "can not create notification pipe");
+            // the owner drains the pipe without blocking, and the work
+            // items' processes should not inherit the pipe
+            for (int fd: notify_fds_) {
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+                fcntl(fd, F_SETFD, FD_CLOEXEC);
+            }
+            if (!output_options_.store_prefix.empty())
+                output_store_ = std::make_unique<Output_store>(
+                        output_options_.store_prefix);
+            for (int slot = 0; slot < nr_slots_; ++slot) {
+                is_cancelled_[slot] = false;
+                envs_.push_back(env);
+                envs_.back()["WORKER_SLOT"] = std::to_string(slot);
+            }
+            for (int slot = 0; slot < nr_slots_; ++slot)
+                threads_.emplace_back(&Slot_pool::run, this, slot);
+        }
+
+        Slot_pool::~Slot_pool() {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                is_done_ = true;
+            }
+            task_available_.notify_all();
+            for (auto& thread: threads_)
+                thread.join();
+            close(notify_fds_[0]);
+            close(notify_fds_[1]);
+        }
+
+        void Slot_pool::submit(size_t work_id, std::string work_item) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                tasks_.push_back({work_id, std::move(work_item)});
+                ++nr_busy_;
+            }
+            task_available_.notify_one();
+        }
+
+        std::vector<Completed> Slot_pool::completed() {
+            char buffer[64];
+            while (read(notify_fds_[0], buffer, sizeof(buffer)) > 0)
+                ;
+            std::vector<Completed> items;
+            std::lock_guard<std::mutex> lock(mutex_);
+            items.swap(completed_);
+            nr_busy_ -= items.size();
+            return items;
+        }
+
+        std::vector<size_t> Slot_pool::withdraw() {
+            std::vector<size_t> work_ids;
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (const auto& task: tasks_)
+                work_ids.push_back(task.work_id);
+            tasks_.clear();
+            nr_busy_ -= work_ids.size();
+            return work_ids;
+        }
+
+        bool Slot_pool::cancel(size_t work_id) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                for (int slot = 0; slot < nr_slots_; ++slot)
+                    if (running_[slot] == work_id) {
+                        is_cancelled_[slot] = true;
+                        return true;
+                    }
+                auto task = std::find_if(tasks_.begin(), tasks_.end(),
+                        [work_id] (const Task& task) {
+                            return task.work_id == work_id;
+                        });
+                if (task == tasks_.end())
+                    return false;
+                tasks_.erase(task);
+                completed_.push_back({work_id, -1,
+                                      Result(128 + SIGTERM, "", "")});
+            }
+            const char signal {'c'};
+            write(notify_fds_[1], &signal, 1);
+            return true;
+        }
+
+        size_t Slot_pool::nr_busy() const {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return nr_busy_;
+        }
+
+        void Slot_pool::run(int slot) {
+            Env& env = envs_[slot];
+            // a slot that can not start a persistent shell launches a
+            // shell per work item instead, with boost::process as a last
+            // resort
+            std::unique_ptr<Shell> shell;
+            std::unique_ptr<Launcher> launcher;
+            if (shell_options_.is_persistent) {
+                try {
+                    shell = std::make_unique<Shell>(env, output_options_,
+                                                    shell_options_.is_login);
+                } catch (std::system_error& err) {
+                    BOOST_LOG_TRIVIAL(warning) << "slot " << slot
+                        << " can not start a persistent shell, "
+                        << err.what();
+                }
+            }
+            if (!shell) {
+                try {
+                    launcher = std::make_unique<Launcher>(env, output_options_,
+                                                          shell_options_.is_login);
+                } catch (std::system_error& err) {
+                    BOOST_LOG_TRIVIAL(warning) << "slot " << slot
+                        << " can not set up launching shells, "
+                        << err.what();
+                }
+            }
+            for (;;) {
+                Task task;
+                {
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    task_available_.wait(lock, [this] {
+                        return is_done_ || !tasks_.empty();
+                    });
+                    if (tasks_.empty())
+                        return;
+                    task = std::move(tasks_.front());
+                    tasks_.pop_front();
+                    running_[slot] = task.work_id;
+                    is_cancelled_[slot] = false;
+                }
+                // a walltime directive of the work item overrides the
+                // default limit
+                auto time_limit = time_limit_;
+                try {
+                    auto directives = parse_directives(task.work_item);
+                    if (directives.walltime.count() > 0)
+                        time_limit = directives.walltime;
+                } catch (directive_parse_exception& err) {
+                    BOOST_LOG_TRIVIAL(warning) << "workitem " << task.work_id
+                        << " has a malformed directive, " << err.what();
+                }
+                auto run = [&] {
+                    if (shell)
+                        return shell->run(task.work_item, task.work_id,
+                                          time_limit, &is_cancelled_[slot]);
+                    if (launcher)
+                        return launcher->run(task.work_item, task.work_id,
+                                             time_limit, &is_cancelled_[slot]);
+                    env["WORKER_ITEM_ID"] = std::to_string(task.work_id);
+                    return process_work(task.work_item, env, output_options_,
+                                        shell_options_, time_limit,
+                                        &is_cancelled_[slot]);
+                };
+                // a work item that can not be run, e.g., since its
+                // output can not be captured or stored, fails, rather
+                // than the client
+                auto result = [&] {
+                    try {
+                        auto result = run();
+                        if (output_store_)
+                            return output_store_->store(result);
+                        return result;
+                    } catch (std::system_error& err) {
+                        BOOST_LOG_TRIVIAL(error) << "workitem " << task.work_id
+                            << " could not be run, " << err.what();
+                        return Result(run_failed_status, "",
+                                      std::string("worker: ") + err.what() + "\n");
+                    }
+                }();
+                if (result.is_timed_out())
+                    BOOST_LOG_TRIVIAL(warning) << "workitem " << task.work_id
+                        << " exceeded its walltime of " << time_limit.count()
+                        << " s, killed";
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    completed_.push_back({task.work_id, slot, std::move(result)});
+                    running_[slot] = 0;
+                }
+                const char signal {'c'};
+                write(notify_fds_[1], &signal, 1);
+            }
+        }
+
+    }
+}
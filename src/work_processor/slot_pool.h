@@ -0,0 +1,188 @@
+/*!
+  \file
+  \brief Pool of slots that process work items concurrently
+ */
+#ifndef SLOT_POOL_HDR
+#define SLOT_POOL_HDR
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "output_store.h"
+#include "processor.h"
+#include "result.h"
+
+namespace worker {
+    namespace work_processor {
+
+        /*!
+          \brief Result of a work item processed by a slot
+         */
+        struct Completed {
+            //! ID of the work item
+            size_t work_id;
+            //! slot the work item was processed in, -1 if it was
+            //! cancelled before it started
+            int slot;
+            //! result of processing the work item
+            Result result;
+        };
+
+        /*!
+          \brief Pool of threads, each of which processes a single work
+                 item at the time.
+
+          Work items are submitted to the pool and processed by the first
+          slot that becomes available.  Completed work items are collected
+          by the owner of the pool.  Since the owner typically waits for
+          messages from the server as well, the pool provides a file
+          descriptor that becomes readable when work items are completed,
+          so that it can be polled along with 0MQ sockets.
+         */
+        class Slot_pool {
+            public:
+                /*!
+                  \brief Slot_pool constructor.
+                  \param nr_slots int number of work items that can be
+                         processed concurrently.
+                  \param env Env environment to run the work items in,
+                         each slot has its own copy that has the
+                         WORKER_SLOT variable set.
+                  \param output_options Output_options bounds on the
+                         output of a work item that is kept in memory.
+                  \param shell_options Shell_options whether work items
+                         run in a login shell, and whether each slot keeps
+                         a persistent shell.
+                  \param time_limit std::chrono::seconds walltime limit
+                         of work items that have no walltime directive, 0
+                         for none.
+                 */
+                Slot_pool(int nr_slots, const Env& env,
+                          const Output_options& output_options,
+                          const Shell_options& shell_options,
+                          std::chrono::seconds time_limit);
+
+                /*!
+                  \brief Slot_pool destructor, waits for the work items
+                         that are being processed to finish.
+                 */
+                ~Slot_pool();
+
+                Slot_pool(const Slot_pool&) = delete;
+                Slot_pool& operator=(const Slot_pool&) = delete;
+
+                /*!
+                  \brief submit a work item for processing.
+                  \param work_id size_t ID of the work item.
+                  \param work_item std::string Bash script to execute,
+                         moved into the pool.
+                 */
+                void submit(size_t work_id, std::string work_item);
+
+                /*!
+                  \brief returns the work items completed since the
+                         previous call.
+                  \return vector of completed work items, possibly empty.
+                 */
+                std::vector<Completed> completed();
+
+                /*!
+                  \brief withdraw the work items that are still waiting for
+                         a slot, they will not be processed.
+                  \return IDs of the withdrawn work items.
+                 */
+                std::vector<size_t> withdraw();
+
+                /*!
+                  \brief cancel a work item, if it is waiting for a slot,
+                         it completes at once, if it is running, its
+                         process group is killed.  Either way, its
+                         completion is collected as usual, it has exit
+                         status 143, as if it was terminated by SIGTERM.
+                  \param work_id size_t ID of the work item.
+                  \return true if the work item was queued or running.
+                 */
+                bool cancel(size_t work_id);
+
+                /*!
+                  \brief returns the number of slots.
+                  \return number of work items that can be processed
+                          concurrently.
+                 */
+                int nr_slots() const { return nr_slots_; };
+
+                /*!
+                  \brief returns the number of work items that have been
+                         submitted, but whose completion was not yet
+                         collected.
+                  \return number of work items queued, in progress or
+                          completed, but not yet collected.
+                 */
+                size_t nr_busy() const;
+
+                /*!
+                  \brief returns a file descriptor that is readable when
+                         completed work items can be collected.
+                  \return file descriptor.
+                 */
+                int notify_fd() const { return notify_fds_[0]; };
+
+            private:
+                //! work item waiting for a slot
+                struct Task {
+                    size_t work_id;
+                    std::string work_item;
+                };
+                //! number of slots
+                int nr_slots_;
+                //! environment for each slot
+                std::vector<Env> envs_;
+                //! bounds on the output kept in memory
+                Output_options output_options_;
+                //! shell the work items run in
+                Shell_options shell_options_;
+                //! default walltime limit of work items
+                std::chrono::seconds time_limit_;
+                //! storage for the output of work items, if the client
+                //! stores it
+                std::unique_ptr<Output_store> output_store_;
+                //! threads processing the work items, one per slot
+                std::vector<std::thread> threads_;
+                //! protects the task queue, the completed items, the
+                //! running items and the busy count
+                mutable std::mutex mutex_;
+                //! signals that tasks are available or that the pool
+                //! shuts down
+                std::condition_variable task_available_;
+                //! work items waiting for a slot
+                std::deque<Task> tasks_;
+                //! completed work items not yet collected
+                std::vector<Completed> completed_;
+                //! ID of the work item each slot runs, 0 if none
+                std::vector<size_t> running_;
+                //! set for a slot when its work item is cancelled
+                std::unique_ptr<std::atomic<bool>[]> is_cancelled_;
+                //! number of work items submitted but not yet collected
+                size_t nr_busy_;
+                //! true when the pool is shutting down
+                bool is_done_;
+                //! pipe used to notify the owner of completed items
+                int notify_fds_[2];
+                /*!
+                  \brief function executed by the thread of a slot.
+                  \param slot int slot number.
+                 */
+                void run(int slot);
+        };
+
+    }
+}
+
+#endif
@@ -0,0 +1,162 @@
+import math
+import struct
+import uuid
+import pytest
+from worker.log_parsers import JournalParser, UsageParser, get_nr_remaining_items
+
+CLIENT_A = uuid.UUID('11111111-2222-3333-4444-555555555555')
+CLIENT_B = uuid.UUID('66666666-7777-8888-9999-000000000000')
+
+
+def header(nr_items, resumed_dir=b''):
+    return (b'WRKJNL01' + struct.pack('<qQQ', 0, nr_items, len(resumed_dir)) +
+            resumed_dir)
+
+def client(number, client_id):
+    return struct.pack('<c3xI', b'c', number) + client_id.bytes
+
+def record(event, value, work_id, time):
+    return struct.pack('<c3xiQq', event, value, work_id, time)
+
+def started(client_number, work_id, time):
+    return record(b's', client_number, work_id, time)
+
+def done(work_id, exit_status, time):
+    return record(b'd', exit_status, work_id, time)
+
+def write_journal(tmp_path, *records, nr_items=4, resumed_dir=b''):
+    file_name = tmp_path / 'journal.bin'
+    file_name.write_bytes(header(nr_items, resumed_dir) + b''.join(records))
+    return file_name
+
+
+def test_empty_journal(tmp_path):
+    file_name = write_journal(tmp_path)
+    assert JournalParser().parse(file_name) is None
+
+def test_not_a_journal(tmp_path):
+    file_name = tmp_path / 'journal.bin'
+    file_name.write_bytes(b'not a journal at all, but long enough')
+    with pytest.raises(Exception, match='not a journal'):
+        JournalParser().parse(file_name)
+
+def test_client_categoricals(tmp_path):
+    file_name = write_journal(tmp_path,
+        client(0, CLIENT_A), started(0, 1, 1000),
+        client(1, CLIENT_B), started(1, 2, 2000),
+        started(0, 3, 3000),
+        done(1, 0, 5000), done(2, 1, 6000),
+        resumed_dir=b'/previous/run')
+    report = JournalParser().parse(file_name)
+    df = report.raw
+    assert list(df.index) == [1, 2, 3]
+    assert list(df['client_id']) == [str(CLIENT_A), str(CLIENT_B), str(CLIENT_A)]
+    assert sorted(report.client_ids) == sorted([str(CLIENT_A), str(CLIENT_B)])
+    assert report.successes == [1]
+    assert report.failures == [2]
+    assert report.incompletes == [3]
+
+def test_first_done_wins(tmp_path):
+    file_name = write_journal(tmp_path,
+        client(0, CLIENT_A), started(0, 1, 1000),
+        client(1, CLIENT_B), started(1, 1, 2000),
+        done(1, 0, 5000), done(1, 3, 9000))
+    df = JournalParser().parse(file_name).raw
+    assert df.loc[1, 'status'] == 0
+    assert df.loc[1, 'duration'].total_seconds() == pytest.approx(0.003)
+
+def test_last_start_wins(tmp_path):
+    file_name = write_journal(tmp_path,
+        client(0, CLIENT_A), started(0, 2, 1000),
+        record(b'r', 0, 2, 1500),
+        client(1, CLIENT_B), started(1, 2, 2000),
+        record(b't', 0, 2, 2500), done(2, 143, 4000))
+    report = JournalParser().parse(file_name)
+    df = report.raw
+    assert df.loc[2, 'client_id'] == str(CLIENT_B)
+    assert df.loc[2, 'start_time'].value//1000 == 2000
+    assert df.loc[2, 'status'] == 143
+    assert report.timed_outs == [2]
+
+def test_partial_record_ignored(tmp_path):
+    file_name = write_journal(tmp_path,
+        client(0, CLIENT_A), started(0, 1, 1000),
+        done(1, 0, 2000)[:10])
+    df = JournalParser().parse(file_name).raw
+    assert list(df.index) == [1]
+    assert math.isnan(df.loc[1, 'status'])
+
+def test_journal_header(tmp_path):
+    file_name = write_journal(tmp_path, nr_items=7, resumed_dir=b'/previous/run')
+    parser = JournalParser()
+    parser.parse(file_name)
+    assert parser.nr_items == 7
+    assert parser.resumed_dir == '/previous/run'
+
+
+def write_log(job_dir, *lines):
+    job_dir.mkdir()
+    (job_dir / 'server.log').write_text(''.join(
+        f'2026-01-01 12:00:0{i}.000000 [info]: {line}\n'
+        for i, line in enumerate(lines)))
+
+def test_remaining_items(tmp_path):
+    # the first job has only a log, the second resumed it, and has a journal
+    write_log(tmp_path / 'first',
+              'workfile has 4 work items, index built',
+              f'workitem 1 started: {CLIENT_A}',
+              f'workitem 2 started: {CLIENT_A}',
+              'workitem 1 done: 0',
+              'workitem 2 done: 1')
+    second_dir = tmp_path / 'second'
+    second_dir.mkdir()
+    write_journal(second_dir,
+                  client(0, CLIENT_B), started(0, 3, 1000),
+                  started(0, 4, 2000), done(3, 0, 3000),
+                  resumed_dir=str(tmp_path / 'first').encode())
+    assert get_nr_remaining_items(tmp_path / 'first') == 2
+    assert get_nr_remaining_items(tmp_path / 'first', is_redo=True) == 3
+    assert get_nr_remaining_items(second_dir) == 1
+    assert get_nr_remaining_items(second_dir, is_redo=True) == 2
+
+def test_nothing_remaining(tmp_path):
+    write_log(tmp_path / 'job',
+              'workfile has 1 work items, index built',
+              f"resumed from '{tmp_path / 'job'}'",
+              f'workitem 1 started: {CLIENT_A}',
+              'workitem 1 done: 0')
+    assert get_nr_remaining_items(tmp_path / 'job') == 0
+
+def test_remaining_unknown(tmp_path):
+    assert get_nr_remaining_items(tmp_path) is None
+
+
+USAGE_HEADER = ('item_id\tstatus\twalltime_us\tuser_time_us\t'
+                'system_time_us\tmax_rss_kb\tread_blocks\twrite_blocks\n')
+
+def test_usage(tmp_path):
+    file_name = tmp_path / 'usage.txt'
+    file_name.write_text(USAGE_HEADER +
+                         '3\t1\t4000000\t1000000\t1000000\t2048\t8\t16\n'
+                         '1\t0\t2000000\t3000000\t1000000\t1024\t0\t0\n')
+    usage = UsageParser().parse(file_name)
+    assert list(usage.index) == [1, 3]
+    assert list(usage['status']) == [0, 1]
+    assert usage.loc[1, 'walltime'] == pytest.approx(2.0)
+    assert usage.loc[3, 'user_time'] == pytest.approx(1.0)
+    assert usage.loc[3, 'max_rss_mb'] == pytest.approx(2.0)
+    assert usage.loc[3, 'write_blocks'] == 16
+    # a work item that kept two cores busy
+    assert usage.loc[1, 'cpu_usage'] == pytest.approx(2.0)
+    assert usage.loc[3, 'cpu_usage'] == pytest.approx(0.5)
+
+def test_usage_zero_walltime(tmp_path):
+    file_name = tmp_path / 'usage.txt'
+    file_name.write_text(USAGE_HEADER + '1\t0\t0\t0\t0\t512\t0\t0\n')
+    usage = UsageParser().parse(file_name)
+    assert math.isnan(usage.loc[1, 'cpu_usage'])
+
+def test_usage_empty(tmp_path):
+    file_name = tmp_path / 'usage.txt'
+    file_name.write_text(USAGE_HEADER)
+    assert UsageParser().parse(file_name) is None
@@ -0,0 +1,93 @@
+import argparse
+import os
+import pytest
+from worker.utils import (copy_workfile, get_resume_option, get_retry_option,
+                          get_schedule_option, get_shell_option)
+
+
+def options(**values):
+    defaults = {
+        'persistent_shell': False,
+        'no_login': False,
+        'max_attempts': 1,
+        'retry_exit_codes': None,
+        'retry_backoff': None,
+        'retry_elsewhere': False,
+        'estimates': None,
+        'longest_first': False,
+    }
+    defaults.update(values)
+    return argparse.Namespace(**defaults)
+
+
+def test_shell_option_default():
+    assert get_shell_option(options()) == ''
+
+def test_shell_option():
+    assert (get_shell_option(options(persistent_shell=True, no_login=True)) ==
+            '--persistent_shell --no_login')
+
+def test_resume_option_no_dir():
+    assert get_resume_option(options()) == ''
+
+def test_resume_option(tmp_path):
+    opt = get_resume_option(options(dir=str(tmp_path)))
+    assert opt == f'--resume "{tmp_path.resolve()}"'
+
+def test_resume_option_redo(tmp_path):
+    opt = get_resume_option(options(dir=str(tmp_path), redo=True))
+    assert opt == f'--resume "{tmp_path.resolve()}" --redo'
+
+def test_retry_option_single_attempt():
+    assert get_retry_option(options(retry_exit_codes='1,2')) == ''
+
+def test_retry_option():
+    opt = get_retry_option(options(max_attempts=3, retry_exit_codes='1,2',
+                                   retry_backoff=5, retry_elsewhere=True))
+    assert opt == ('--max_attempts 3 --retry_exit_codes 1,2 '
+                   '--retry_backoff 5 --retry_elsewhere')
+
+def test_retry_option_zero_backoff():
+    opt = get_retry_option(options(max_attempts=2, retry_backoff=0))
+    assert opt == '--max_attempts 2 --retry_backoff 0'
+
+def test_schedule_option_default():
+    assert get_schedule_option(options()) == ''
+
+def test_schedule_option_longest_first():
+    assert get_schedule_option(options(longest_first=True)) == '--longest_first'
+
+def test_schedule_option_estimates(tmp_path):
+    opt = get_schedule_option(options(estimates=str(tmp_path)))
+    assert opt == f'--estimates "{tmp_path.resolve()}"'
+
+def test_schedule_option_resumed(tmp_path):
+    # a resumed job takes the walltimes from the previous job
+    opt = get_schedule_option(options(longest_first=True, dir=str(tmp_path)))
+    assert opt == f'--estimates "{tmp_path.resolve()}"'
+    assert get_schedule_option(options(dir=str(tmp_path))) == ''
+
+def test_copy_workfile(tmp_path):
+    previous_dir = tmp_path / 'previous'
+    previous_dir.mkdir()
+    workfile_path = previous_dir / 'workerfile.txt'
+    workfile_path.write_text('echo 1\n#WORKER----\necho 2\n')
+    index_path = previous_dir / 'workerfile.txt.idx'
+    index_path.write_bytes(b'\x00\x01\x02')
+    os.utime(workfile_path, (1000000, 1000000))
+    file_path = tmp_path / 'workerfile.txt'
+    copy_workfile(workfile_path, file_path)
+    assert file_path.read_text() == workfile_path.read_text()
+    # the index stays valid, since the modification time is kept
+    assert file_path.stat().st_mtime == workfile_path.stat().st_mtime
+    assert (tmp_path / 'workerfile.txt.idx').read_bytes() == b'\x00\x01\x02'
+
+def test_copy_workfile_no_index(tmp_path):
+    previous_dir = tmp_path / 'previous'
+    previous_dir.mkdir()
+    workfile_path = previous_dir / 'workerfile.txt'
+    workfile_path.write_text('echo 1\n')
+    file_path = tmp_path / 'workerfile.txt'
+    copy_workfile(workfile_path, file_path)
+    assert file_path.read_text() == 'echo 1\n'
+    assert not (tmp_path / 'workerfile.txt.idx').exists()